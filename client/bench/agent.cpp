@@ -0,0 +1,737 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+// hot paths of the agent against an in-process server on loopback: agent_bench [messages per run]
+//
+//   dataset    building and serializing rows, per cell type and encoding, and typed_dataset rows
+//   series     appending samples to a time series and summarizing them into a bucket
+//   telemetry  a collect of the process's readings from /proc, with a few threads to follow
+//   send       agent::send throughput and the latency of the call, sync, async and through the shared memory ring
+//   stream     agent::stream of a traced command's answer in frames of config::stream_rows, every frame has to parse
+//   dispatch   from the server writing a command to its handler running, on the io thread and on an executor
+//   priority   a control command sent while slow ones keep the handlers' executor busy, with and without priority
+//   reconnect  from the server dropping the connection to the next login
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "supermon/agent.h"
+
+#include "report.h"
+#include "sink.h"
+
+using clock_type = std::chrono::steady_clock;
+
+static std::uint64_t nanoseconds(clock_type::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+static std::uint64_t now()
+{
+    return nanoseconds(clock_type::now().time_since_epoch());
+}
+
+static bool wait_for(const std::function<bool ()>& done, std::chrono::seconds timeout = std::chrono::seconds(30))
+{
+    const auto deadline = clock_type::now() + timeout;
+    while (!done())
+    {
+        if (clock_type::now() > deadline) return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+static const char* encodings[] = { "json", "msgpack" };
+
+// an agent logged in to the sink, ready once the sink's {"ready":{}} went through its dispatch
+class session
+{
+public:
+    session(sink& server, bool async, supermon::encoding encoding, const std::function<void (supermon::agent&)>& setup = nullptr)
+    {
+        supermon::config config;
+        config.name = "agent_bench";
+        config.instance = "bench";
+        config.host = "127.0.0.1";
+        config.port = server.port();
+        config.async = async;
+        config.overflow = supermon::overflow::block;
+        config.encoding = encoding;
+        config.metrics_interval = std::chrono::milliseconds(0);
+        config.status_rate = 0;
+        config.reconnect_min = config.reconnect_max = std::chrono::milliseconds(1);
+
+        agent.reset(new supermon::agent(config));
+        agent->on("ready", [this](std::string_view, const supermon::json::value&, const supermon::json::value&)
+        {
+            ++ready;
+        });
+        if (setup) setup(*agent);
+
+        agent->connect();
+        if (!wait_for([this]() { return 0 < ready; })) throw std::runtime_error("agent didn't connect");
+    }
+
+public:
+    std::unique_ptr<supermon::agent> agent;
+    std::atomic<std::uint64_t>       ready = {0};
+};
+
+template<typename F>
+static double seconds(F&& f)
+{
+    const auto start = clock_type::now();
+    f();
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+SUPERMON_COLUMN(c0, bool, "c0");
+SUPERMON_COLUMN(c1, long long, "c1");
+SUPERMON_COLUMN(c2, double, "c2");
+SUPERMON_COLUMN(c3, std::string, "c3");
+SUPERMON_COLUMN(c4, bool, "c4");
+SUPERMON_COLUMN(c5, long long, "c5");
+SUPERMON_COLUMN(c6, double, "c6");
+SUPERMON_COLUMN(c7, std::string, "c7");
+
+using typed = supermon::typed_dataset<c0, c1, c2, c3, c4, c5, c6, c7>;
+
+static void bench_dataset(std::size_t messages)
+{
+    const std::size_t rows = 1000;
+    const std::size_t columns = 8;
+    const std::size_t passes = std::max<std::size_t>(1, messages / 100);
+    const char* words[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel" };
+
+    const char* kinds[] = { "bool", "int64", "float64", "string", "mixed" };
+    for (std::size_t kind = 0; kind < 5; ++kind)
+    {
+        supermon::dataset data;
+        const auto build = [&]()
+        {
+            data.clear();
+            for (std::size_t i = 0; i < rows; ++i)
+            {
+                auto& row = data.insertRow();
+                for (std::size_t c = 0; c < columns; ++c)
+                {
+                    switch (4 == kind ? c % 4 : kind)
+                    {
+                        case 0:  row.add(0 == (i + c) % 2); break;
+                        case 1:  row.add(static_cast<long long>(i * columns + c)); break;
+                        case 2:  row.add(0.25 * i + c); break;
+                        default: row.add(words[(i + c) % 8]); break;
+                    }
+                }
+            }
+        };
+
+        const double built = seconds([&]() { for (std::size_t n = 0; n < passes; ++n) build(); });
+
+        std::string frame;
+        const double json = seconds([&]()
+        {
+            for (std::size_t n = 0; n < passes; ++n)
+            {
+                frame.clear();
+                supermon::json::writer w(frame);
+                data.write(w);
+            }
+        });
+        const std::size_t json_bytes = frame.size();
+
+        const double msgpack = seconds([&]()
+        {
+            for (std::size_t n = 0; n < passes; ++n)
+            {
+                frame.clear();
+                supermon::msgpack::writer w(frame);
+                data.write(w);
+            }
+        });
+
+        const double total = static_cast<double>(passes * rows);
+        report("dataset", kinds[kind])
+            ("columns", columns)
+            ("rows", passes * rows)
+            ("build_ns_per_row", 1e9 * built / total)
+            ("json_ns_per_row", 1e9 * json / total)
+            ("json_bytes_per_row", static_cast<double>(json_bytes) / rows)
+            ("msgpack_ns_per_row", 1e9 * msgpack / total)
+            ("msgpack_bytes_per_row", static_cast<double>(frame.size()) / rows);
+    }
+
+    // the mixed rows again with the column types known at compile time
+    typed data;
+    const double built = seconds([&]()
+    {
+        for (std::size_t n = 0; n < passes; ++n)
+        {
+            data.clear();
+            for (std::size_t i = 0; i < rows; ++i)
+            {
+                data.insert(0 == i % 2, static_cast<long long>(i * columns + 1), 0.25 * i + 2, words[(i + 3) % 8],
+                            0 == (i + 4) % 2, static_cast<long long>(i * columns + 5), 0.25 * i + 6, words[(i + 7) % 8]);
+            }
+        }
+    });
+
+    std::string frame;
+    const double json = seconds([&]()
+    {
+        for (std::size_t n = 0; n < passes; ++n)
+        {
+            frame.clear();
+            supermon::json::writer w(frame);
+            data.write(w);
+        }
+    });
+    const std::size_t json_bytes = frame.size();
+
+    const double msgpack = seconds([&]()
+    {
+        for (std::size_t n = 0; n < passes; ++n)
+        {
+            frame.clear();
+            supermon::msgpack::writer w(frame);
+            data.write(w);
+        }
+    });
+
+    const double total = static_cast<double>(passes * rows);
+    report("dataset", "typed")
+        ("columns", columns)
+        ("rows", passes * rows)
+        ("build_ns_per_row", 1e9 * built / total)
+        ("json_ns_per_row", 1e9 * json / total)
+        ("json_bytes_per_row", static_cast<double>(json_bytes) / rows)
+        ("msgpack_ns_per_row", 1e9 * msgpack / total)
+        ("msgpack_bytes_per_row", static_cast<double>(frame.size()) / rows);
+}
+
+static void bench_series(std::size_t messages)
+{
+    const std::size_t capacity = 64 * 1024;
+    const std::size_t passes = std::max<std::size_t>(1, messages / 1000);
+
+    for (std::size_t columns : { 1, 4 })
+    {
+        std::vector<std::string> names;
+        for (std::size_t c = 0; c < columns; ++c) names.push_back("c" + std::to_string(c));
+        supermon::series s(names, capacity);
+
+        std::vector<double> values(columns);
+        double appended = 0;
+        double bucketed = 0;
+        supermon::dataset data;
+        for (std::size_t n = 0; n < passes; ++n)
+        {
+            appended += seconds([&]()
+            {
+                for (std::size_t i = 0; i < capacity; ++i)
+                {
+                    for (std::size_t c = 0; c < columns; ++c) values[c] = 0.001 * ((i * 7 + c) % 1000);
+                    s.append(static_cast<std::int64_t>(i), values.data(), columns);
+                }
+            });
+            data.clear();
+            bucketed += seconds([&]() { s.bucket(data.insertRow()); });
+        }
+
+        const double total = static_cast<double>(passes * capacity);
+        report("series", std::to_string(columns) + (1 == columns ? "_column" : "_columns"))
+            ("samples", passes * capacity)
+            ("append_ns_per_sample", 1e9 * appended / total)
+            ("bucket_ns_per_sample", 1e9 * bucketed / total);
+    }
+}
+
+static void bench_telemetry(std::size_t messages)
+{
+    supermon::telemetry telemetry;
+    if (!telemetry.available()) return;
+
+    std::atomic<bool> done = {false};
+    std::vector<std::thread> threads;
+    for (int n = 0; n < 4; ++n)
+    {
+        threads.emplace_back([&done]() { while (!done) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+    }
+
+    supermon::dataset data;
+    telemetry.collect(data, std::chrono::seconds(1));
+
+    const std::size_t collects = std::max<std::size_t>(100, messages / 100);
+    std::vector<std::uint64_t> samples;
+    samples.reserve(collects);
+    for (std::size_t n = 0; n < collects; ++n)
+    {
+        data.clear();
+        const auto start = clock_type::now();
+        telemetry.collect(data, std::chrono::seconds(1));
+        samples.push_back(nanoseconds(clock_type::now() - start));
+    }
+
+    done = true;
+    for (auto& t : threads) t.join();
+
+    report("telemetry", "proc_self")
+        ("collects", collects)
+        ("rows", data.size())
+        .percentiles(samples, "ns");
+}
+
+static void bench_send(std::size_t messages)
+{
+    supermon::dataset table;
+    table.header.add_pack("id", "name", "value", "ok");
+    for (int i = 0; i < 100; ++i)
+    {
+        table.insert(i, "row " + std::to_string(i), 0.5 * i, 0 == i % 3);
+    }
+    const std::string text(120, 'x');
+
+    for (bool async : { false, true })
+    {
+        for (std::size_t e = 0; e < 2; ++e)
+        {
+            for (bool rows : { false, true })
+            {
+                sink server(1 == e);
+                session s(server, async, 1 == e ? supermon::encoding::msgpack : supermon::encoding::json);
+
+                // every call of a run is timed, the run is over when the server has all of it
+                const std::size_t count = rows ? std::max<std::size_t>(1, messages / 10) : messages;
+                std::vector<std::uint64_t> latency(count);
+                const double elapsed = seconds([&]()
+                {
+                    for (std::size_t n = 0; n < count; ++n)
+                    {
+                        const auto start = clock_type::now();
+                        if (rows) s.agent->send("bench", table);
+                        else s.agent->send("bench", text);
+                        latency[n] = nanoseconds(clock_type::now() - start);
+                    }
+                    wait_for([&]() { return server.frames() >= count; });
+                });
+
+                const std::string name = std::string(async ? "async/" : "sync/") + encodings[e] + (rows ? "/dataset" : "/text");
+                report("send", name)
+                    ("messages", count)
+                    ("received", server.frames())
+                    ("ops_per_s", count / elapsed)
+                    ("mb_per_s", server.bytes() / elapsed / (1024 * 1024))
+                    .percentiles(latency, "ns");
+            }
+        }
+    }
+}
+
+// transport::ring, with a thread reading the ring where the relay would
+static void bench_ring(std::size_t messages)
+{
+    supermon::dataset table;
+    table.header.add_pack("id", "name", "value", "ok");
+    for (int i = 0; i < 4; ++i)
+    {
+        table.insert(i, "row " + std::to_string(i), 0.5 * i, 0 == i % 3);
+    }
+    const std::string text(120, 'x');
+    const std::string name = "agent_bench." + std::to_string(::getpid());
+
+    for (std::size_t e = 0; e < 2; ++e)
+    {
+        for (bool rows : { false, true })
+        {
+            supermon::config config;
+            config.name = "agent_bench";
+            config.instance = "bench";
+            config.transport = supermon::transport::ring;
+            config.ring = name;
+            config.ring_bytes = 64 * 1024 * 1024;
+            config.ring_poll = std::chrono::microseconds(100);
+            config.encoding = 1 == e ? supermon::encoding::msgpack : supermon::encoding::json;
+            config.metrics_interval = std::chrono::milliseconds(0);
+            config.status_rate = 0;
+
+            std::atomic<std::uint64_t> ready = {0};
+            supermon::agent agent(config);
+            agent.on("ready", [&](std::string_view, const supermon::json::value&, const supermon::json::value&)
+            {
+                ++ready;
+            });
+
+            supermon::ring outbound(name + ".out", 0, false);
+            supermon::ring inbound(name + ".in", 0, false);
+            inbound.push("{\"login\":{\"head\":{},\"body\":{}}}");
+            if (1 == e) inbound.push("{\"login\":{\"head\":{},\"body\":{\"encoding\":\"msgpack\"}}}");
+            inbound.push("{\"ready\":{\"head\":{},\"body\":{}}}");
+
+            agent.connect();
+            if (!wait_for([&]() { return 0 < ready; })) throw std::runtime_error("agent didn't read the ring");
+
+            std::atomic<bool> stop = {false};
+            std::atomic<std::uint64_t> received = {0};
+            std::atomic<std::uint64_t> bytes = {0};
+            std::thread reader([&]()
+            {
+                std::string frame;
+                while (!stop)
+                {
+                    if (!outbound.front(frame)) continue;
+                    outbound.pop();
+                    ++received;
+                    bytes += frame.size();
+                }
+            });
+            wait_for([&]() { return outbound.empty(); }); // the login
+            received = 0;
+            bytes = 0;
+
+            const std::size_t count = messages;
+            std::vector<std::uint64_t> latency(count);
+            const double elapsed = seconds([&]()
+            {
+                for (std::size_t n = 0; n < count; ++n)
+                {
+                    const auto start = clock_type::now();
+                    if (rows) agent.send("bench", table);
+                    else agent.send("bench", text);
+                    latency[n] = nanoseconds(clock_type::now() - start);
+                }
+                wait_for([&]() { return received >= count - agent.stats().dropped; });
+            });
+
+            stop = true;
+            reader.join();
+            agent.shutdown();
+
+            report("send", std::string("ring/") + encodings[e] + (rows ? "/dataset" : "/text"))
+                ("messages", count)
+                ("received", received.load())
+                ("dropped", agent.stats().dropped)
+                ("ops_per_s", count / elapsed)
+                ("mb_per_s", bytes / elapsed / (1024 * 1024))
+                .percentiles(latency, "ns");
+        }
+    }
+
+    ::shm_unlink(("/" + name + ".out").c_str());
+    ::shm_unlink(("/" + name + ".in").c_str());
+}
+
+template<typename Writer>
+static void command(std::string& frame, std::uint64_t sequence, const char* tag = "bench")
+{
+    Writer w(frame);
+    w.begin_object().key(tag).begin_object()
+        .key("head").begin_object().key("sequence").value(sequence).end_object()
+        .key("body").begin_object()
+            .key("sent").value(now())
+            .key("name").value("dispatch")
+            .key("values").begin_array();
+    for (int i = 0; i < 8; ++i)
+    {
+        w.value(0.5 * i);
+    }
+    w.end_array().end_object().end_object().end_object();
+}
+
+// an io_service run by threads of its own, for handlers to run on
+class pool
+{
+public:
+    explicit pool(std::size_t threads) : _work(new boost::asio::io_service::work(_io))
+    {
+        for (std::size_t n = 0; n < threads; ++n)
+        {
+            _threads.emplace_back([this]() { _io.run(); });
+        }
+    }
+
+    ~pool()
+    {
+        _work.reset();
+        for (auto& t : _threads) t.join();
+    }
+
+    supermon::executor executor()
+    {
+        return supermon::executor::of(_io);
+    }
+
+    void post(std::function<void ()> job)
+    {
+        _io.post(std::move(job));
+    }
+
+private:
+    boost::asio::io_service                         _io;
+    std::unique_ptr<boost::asio::io_service::work>  _work;
+    std::vector<std::thread>                        _threads;
+};
+
+static void bench_dispatch(std::size_t messages)
+{
+    for (bool deferred : { false, true })
+    {
+        for (std::size_t e = 0; e < 2; ++e)
+        {
+            const std::size_t count = std::max<std::size_t>(1, messages / 10);
+            std::vector<std::uint64_t> latency;
+            latency.reserve(count);
+            std::atomic<std::size_t> handled = {0};
+
+            pool threads(1);
+            sink server(1 == e);
+            session s(server, false, 1 == e ? supermon::encoding::msgpack : supermon::encoding::json, [&](supermon::agent& agent)
+            {
+                supermon::execution how;
+                if (deferred) how.executor = threads.executor();
+
+                agent.on("bench", [&](std::string_view, const supermon::json::value&, const supermon::json::value& body)
+                {
+                    latency.push_back(now() - body.get<std::uint64_t>("sent", 0));
+                    ++handled;
+                }, how);
+            });
+
+            // one at a time, so that what's measured is a single command's way through
+            std::string frame;
+            const double elapsed = seconds([&]()
+            {
+                for (std::size_t n = 0; n < count; ++n)
+                {
+                    frame.clear();
+                    if (1 == e) command<supermon::msgpack::writer>(frame, n);
+                    else command<supermon::json::writer>(frame, n);
+
+                    if (!server.command(frame) || !wait_for([&]() { return handled > n; })) break;
+                }
+            });
+
+            report("dispatch", std::string(deferred ? "executor/" : "inline/") + encodings[e])
+                ("commands", count)
+                ("handled", handled.load())
+                ("ops_per_s", handled / elapsed)
+                .percentiles(latency, "ns");
+        }
+    }
+}
+
+// the handler of a traced command returns and the answer is streamed later, from another thread. the trace goes
+// out after the first frame, between the frames of the stream
+static void bench_stream(std::size_t messages)
+{
+    supermon::dataset table;
+    table.header.add_pack("id", "name", "value", "ok");
+    const std::size_t rows = std::max<std::size_t>(3 * 16 * 1024 + 100, messages / 2); // config::stream_rows is 16K
+    for (std::size_t i = 0; i < rows; ++i)
+    {
+        table.insert(static_cast<long long>(i), "row " + std::to_string(i), 0.5 * i, 0 == i % 3);
+    }
+
+    for (bool async : { false, true })
+    {
+        for (std::size_t e = 0; e < 2; ++e)
+        {
+            std::atomic<std::size_t> streamed = {0};
+            pool threads(1);
+            sink server(1 == e, true);
+            session s(server, async, 1 == e ? supermon::encoding::msgpack : supermon::encoding::json, [&](supermon::agent& agent)
+            {
+                agent.on("stream", [&](std::string_view, const supermon::json::value& head, const supermon::json::value&)
+                {
+                    const long port = head.get<long>("port", 0);
+                    threads.post([&, port]()
+                    {
+                        agent.stream("bench", "replace", table, port);
+                        ++streamed;
+                    });
+                });
+            });
+
+            const std::uint64_t before = server.frames();
+            std::string frame;
+            const auto write = [&](auto& w)
+            {
+                w.begin_object().key("stream").begin_object()
+                    .key("head").begin_object()
+                        .key("port").value(7)
+                        .key("trace").begin_object().key("id").value("1").key("hops").begin_object().end_object().end_object()
+                    .end_object()
+                    .key("body").begin_object().end_object()
+                    .end_object().end_object();
+            };
+            if (1 == e)
+            {
+                supermon::msgpack::writer w(frame);
+                write(w);
+            }
+            else
+            {
+                supermon::json::writer w(frame);
+                write(w);
+            }
+
+            // a frame every config::stream_rows rows, and the trace
+            const std::size_t expected = (rows + 16 * 1024 - 1) / (16 * 1024) + 1;
+            const double elapsed = seconds([&]()
+            {
+                if (server.command(frame)) wait_for([&]() { return 0 < streamed && server.frames() - before >= expected; });
+            });
+
+            report("stream", std::string(async ? "async/" : "sync/") + encodings[e])
+                ("rows", rows)
+                ("frames", server.frames() - before)
+                ("malformed", server.malformed())
+                ("rows_per_s", rows / elapsed)
+                ("mb_per_s", server.bytes() / elapsed / (1024 * 1024));
+
+            if (0 < server.malformed()) throw std::runtime_error("stream: the server got frames that don't parse");
+        }
+    }
+}
+
+// slow commands arrive twice as fast as two threads get through them, a control command comes every so often.
+// the control command waits for a thread to come free either way, with priority it doesn't wait for the backlog
+static void bench_priority(std::size_t messages)
+{
+    const std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(100, messages / 1000));
+    const auto slow = std::chrono::microseconds(500);
+
+    for (int priority : { 0, 1 })
+    {
+        std::vector<std::uint64_t> latency;
+        latency.reserve(count);
+        std::atomic<std::size_t> handled = {0};
+        std::atomic<std::size_t> reports = {0};
+
+        pool threads(2);
+        sink server(false);
+        session s(server, false, supermon::encoding::json, [&](supermon::agent& agent)
+        {
+            const auto executor = threads.executor();
+            agent.on("report", [&](std::string_view, const supermon::json::value&, const supermon::json::value&)
+            {
+                const auto until = clock_type::now() + slow;
+                while (clock_type::now() < until) {}
+                ++reports;
+            }, { executor, 0, 0 });
+
+            agent.on("control", [&](std::string_view, const supermon::json::value&, const supermon::json::value& body)
+            {
+                latency.push_back(now() - body.get<std::uint64_t>("sent", 0));
+                ++handled;
+            }, { executor, 0, priority });
+        });
+
+        std::string frame;
+        std::size_t sent = 0;
+        for (std::size_t n = 0; n < count; ++n)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                frame.clear();
+                command<supermon::json::writer>(frame, sent++, "report");
+                server.command(frame);
+            }
+
+            frame.clear();
+            command<supermon::json::writer>(frame, n, "control");
+            if (!server.command(frame) || !wait_for([&]() { return handled > n; })) break;
+            std::this_thread::sleep_for(2 * slow);
+        }
+        wait_for([&]() { return reports >= sent; });
+
+        report("priority", priority ? "control_first" : "in_order")
+            ("commands", count)
+            ("handled", handled.load())
+            ("slow_commands", sent)
+            .percentiles(latency, "ns");
+    }
+}
+
+static void bench_reconnect(std::size_t messages)
+{
+    const std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(200, messages / 100));
+    std::vector<std::uint64_t> offline;
+    std::atomic<std::size_t> reconnects = {0};
+
+    sink server(false);
+    session s(server, false, supermon::encoding::json, [&](supermon::agent& agent)
+    {
+        agent.onreconnect = [&](clock_type::duration d, std::size_t)
+        {
+            offline.push_back(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+            ++reconnects;
+        };
+    });
+
+    for (std::size_t n = 0; n < count; ++n)
+    {
+        // the next session has to be up on the server's side too before it's dropped
+        const std::uint64_t ready = s.ready;
+        server.drop();
+        if (!wait_for([&]() { return reconnects > n && s.ready > ready; })) break;
+    }
+
+    report("reconnect", "loopback")
+        ("drops", count)
+        ("reconnects", reconnects.load())
+        ("backoff_ms", 1)
+        .percentiles(offline, "us");
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const std::size_t messages = 1 < argc ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+        bench_dataset(messages);
+        bench_series(messages);
+        bench_telemetry(messages);
+        bench_send(messages);
+        bench_ring(messages);
+        bench_stream(messages);
+        bench_dispatch(messages);
+        bench_priority(messages);
+        bench_reconnect(messages);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "agent_bench: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,76 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_bench_report_h
+#define supermon_bench_report_h
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "supermon/json.h"
+
+// one result per line as a json object, e.g. {"bench":"send","case":"sync/json/text","ops_per_s":...}
+// so that the output of two commits can be saved and compared with any json lines tool
+class report
+{
+public:
+    report(const char* bench, const std::string& name) : _writer(_line)
+    {
+        _writer.begin_object().key("bench").value(bench).key("case").value(name);
+    }
+
+    ~report()
+    {
+        _writer.end_object();
+        std::cout << _line << std::endl;
+    }
+
+    report(const report&) = delete;
+    report& operator=(const report&) = delete;
+
+public:
+    template<typename T>
+    report& operator()(const char* field, T value)
+    {
+        _writer.key(field).value(value);
+        return *this;
+    }
+
+    // percentiles of the samples, in their unit, under names with the given suffix
+    report& percentiles(std::vector<std::uint64_t>& samples, const char* unit)
+    {
+        if (samples.empty()) return *this;
+
+        std::sort(samples.begin(), samples.end());
+        const auto at = [&](double q) { return samples[std::min(samples.size() - 1, static_cast<std::size_t>(q * samples.size()))]; };
+
+        _writer.key(std::string("p50_") + unit).value(at(0.5));
+        _writer.key(std::string("p90_") + unit).value(at(0.9));
+        _writer.key(std::string("p99_") + unit).value(at(0.99));
+        _writer.key(std::string("p999_") + unit).value(at(0.999));
+        _writer.key(std::string("max_") + unit).value(samples.back());
+        return *this;
+    }
+
+private:
+    std::string                 _line;
+    supermon::json::writer      _writer;
+};
+
+#endif
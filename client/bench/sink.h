@@ -0,0 +1,203 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_bench_sink_h
+#define supermon_bench_sink_h
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "boost/asio.hpp"
+
+#include "beast/websocket.hpp"
+
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
+
+// stand-in for the node server on a loopback port: takes one agent at a time, answers its login and counts
+// what it gets. after the login it sends {"ready":{}}, which tells the agent's side that the answer was seen.
+// commands can be written to the agent and its connection dropped from any thread. it can parse every frame too,
+// to count those that aren't one whole message
+class sink
+{
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    // accept_msgpack: answer a login that offers msgpack with yes. validate: parse each frame, costs throughput
+    explicit sink(bool accept_msgpack, bool validate = false)
+        : _acceptor(_io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), _msgpack(accept_msgpack), _validate(validate)
+    {
+        _thread = std::thread([this]() { run(); });
+    }
+
+    ~sink()
+    {
+        _stop = true;
+        drop();
+
+        // the accept blocks, a connection wakes it up
+        boost::system::error_code ignored;
+        tcp::socket socket(_io);
+        socket.connect(_acceptor.local_endpoint(), ignored);
+        _thread.join();
+    }
+
+    sink(const sink&) = delete;
+    sink& operator=(const sink&) = delete;
+
+public:
+    std::uint16_t port() const
+    {
+        return _acceptor.local_endpoint().port();
+    }
+
+    // frames received after the login, over all sessions
+    std::uint64_t frames() const
+    {
+        return _frames;
+    }
+
+    std::uint64_t bytes() const
+    {
+        return _bytes;
+    }
+
+    // frames that didn't parse as json or msgpack, with validate
+    std::uint64_t malformed() const
+    {
+        return _malformed;
+    }
+
+    // false if no agent is connected
+    bool command(const std::string& frame)
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if (nullptr == _session) return false;
+
+        boost::system::error_code error;
+        _session->binary(supermon::msgpack::packed(frame));
+        _session->write(boost::asio::buffer(frame), error);
+        return !error;
+    }
+
+    // the agent sees the connection lost
+    void drop()
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        if (nullptr != _socket)
+        {
+            boost::system::error_code ignored;
+            _socket->shutdown(tcp::socket::shutdown_both, ignored);
+        }
+    }
+
+private:
+    void run()
+    {
+        while (!_stop)
+        {
+            boost::system::error_code error;
+            tcp::socket socket(_io);
+            _acceptor.accept(socket, error);
+            if (error || _stop) continue;
+
+            socket.set_option(tcp::no_delay(true), error);
+            beast::websocket::stream<tcp::socket&> session(socket);
+            session.accept(error);
+            if (error) continue;
+
+            {
+                std::lock_guard<std::mutex> _(_lock);
+                _session = &session;
+                _socket = &socket;
+            }
+
+            serve(session);
+
+            std::lock_guard<std::mutex> _(_lock);
+            _session = nullptr;
+            _socket = nullptr;
+        }
+    }
+
+    void serve(beast::websocket::stream<tcp::socket&>& session)
+    {
+        boost::asio::streambuf buffer;
+        bool login = true;
+
+        for (;;)
+        {
+            boost::system::error_code error;
+            session.read(buffer, error);
+            if (error) return;
+
+            if (login)
+            {
+                const std::string frame(boost::asio::buffer_cast<const char*>(buffer.data()), buffer.size());
+                if (_msgpack && std::string::npos != frame.find("\"msgpack\""))
+                {
+                    command("{\"login\":{\"head\":{},\"body\":{\"encoding\":\"msgpack\"}}}");
+                }
+                command("{\"ready\":{\"head\":{},\"body\":{}}}");
+                login = false;
+            }
+            else
+            {
+                // counted once it's been looked at, who waits for the frames can read malformed() then
+                if (_validate) validate(buffer);
+                _bytes += buffer.size();
+                ++_frames;
+            }
+            buffer.consume(buffer.size());
+        }
+    }
+
+    void validate(const boost::asio::streambuf& buffer)
+    {
+        // parsed in place, the copy keeps its capacity
+        _frame.assign(boost::asio::buffer_cast<const char*>(buffer.data()), buffer.size());
+        try
+        {
+            if (supermon::msgpack::packed(_frame.data(), _frame.size())) _document.unpack(_frame.data(), _frame.size());
+            else _document.parse(&_frame[0], _frame.size());
+        }
+        catch (const std::exception&)
+        {
+            ++_malformed;
+        }
+    }
+
+private:
+    boost::asio::io_service                     _io;
+    tcp::acceptor                               _acceptor;
+    const bool                                  _msgpack;
+    const bool                                  _validate;
+    std::thread                                 _thread;
+    std::atomic<bool>                           _stop = {false};
+    std::mutex                                  _lock;
+    beast::websocket::stream<tcp::socket&>*     _session = nullptr;
+    tcp::socket*                                _socket = nullptr;
+    std::atomic<std::uint64_t>                  _frames = {0};
+    std::atomic<std::uint64_t>                  _bytes = {0};
+    std::atomic<std::uint64_t>                  _malformed = {0};
+    std::string                                 _frame;
+    supermon::json::document                    _document;
+};
+
+#endif
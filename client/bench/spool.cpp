@@ -0,0 +1,109 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+// append and drain throughput of the on-disk spool: spool_bench [directory] [megabytes per run]
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "supermon/spool.h"
+
+#include "report.h"
+
+static void clean(const std::string& directory)
+{
+    if (DIR* dir = ::opendir(directory.c_str()))
+    {
+        while (const dirent* entry = ::readdir(dir))
+        {
+            if ('.' != entry->d_name[0]) ::unlink((directory + "/" + entry->d_name).c_str());
+        }
+        ::closedir(dir);
+    }
+}
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const std::string directory = 1 < argc ? argv[1] : "spool.bench";
+        const std::size_t megabytes = 2 < argc ? std::strtoul(argv[2], nullptr, 10) : 256;
+
+        for (std::size_t size : { 64, 256, 1024, 4096, 16384 })
+        {
+            clean(directory);
+
+            const std::size_t frames = megabytes * 1024 * 1024 / size;
+            const std::string frame(size, 'x');
+            std::string copy;
+
+            // keeps everything, so that the drain reads what was appended
+            supermon::spool spool(directory, 64 * 1024 * 1024, megabytes / 32 + 2);
+
+            auto start = std::chrono::steady_clock::now();
+            std::size_t lost = 0;
+            for (std::size_t n = 0; n < frames; ++n)
+            {
+                lost += spool.append(frame);
+            }
+            const double append = seconds(start);
+
+            start = std::chrono::steady_clock::now();
+            std::size_t drained = 0;
+            while (spool.front(copy))
+            {
+                drained += copy.size();
+                spool.pop();
+            }
+            const double drain = seconds(start);
+
+            if (0 < lost || drained != frames * size)
+            {
+                std::cerr << "spool lost " << lost << " frames of " << size << " bytes" << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            const double mb = static_cast<double>(frames * size) / (1024 * 1024);
+            report("spool", std::to_string(size) + "B")
+                ("frames", frames)
+                ("append_per_s", frames / append)
+                ("append_mb_per_s", mb / append)
+                ("drain_per_s", frames / drain)
+                ("drain_mb_per_s", mb / drain);
+        }
+
+        clean(directory);
+        ::rmdir(directory.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "spool_bench: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
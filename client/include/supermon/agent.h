@@ -24,24 +24,117 @@
 #include <chrono>
 #include <map>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <string_view>
+#include <functional>
 
 #include "boost/asio.hpp"
 #include "boost/asio/system_timer.hpp"
+#include "boost/asio/steady_timer.hpp"
 #include "boost/property_tree/ptree.hpp"
 
 #include "beast/websocket.hpp"
 
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
 #include "supermon/dataset.h"
+#include "supermon/typed_dataset.h"
+#include "supermon/snapshot.h"
+#include "supermon/metrics.h"
+#include "supermon/queue.h"
+#include "supermon/backlog.h"
+#include "supermon/spool.h"
+#include "supermon/connection.h"
+#include "supermon/ring.h"
+#include "supermon/executor.h"
+#include "supermon/series.h"
+#include "supermon/session.h"
+#include "supermon/result.h"
+#include "supermon/telemetry.h"
 
 namespace supermon
 {
 
+    // what to do when the asynchronous send queue is full
+    enum class overflow
+    {
+        block,       // spin until the io thread makes room
+        drop_newest, // discard the message being sent
+        drop_oldest  // discard the oldest queued message
+    };
+
+    // wire format of the messages, the server has to agree before anything but json is used
+    enum class encoding
+    {
+        json,
+        msgpack
+    };
+
+    // what the agent does with more than one server
+    enum class policy
+    {
+        failover, // talk to one, move on to the next as soon as it's gone
+        fanout    // talk to all of them, every message goes to each one that's up
+    };
+
+    // how the frames get to the server
+    enum class transport
+    {
+        websocket, // the agent connects to the servers itself
+        ring       // through a relay process on the same host, over shared memory
+    };
+
     struct config
     {
-        std::string   name;
-        std::string   instance;
-        std::string   host = {"localhost"};
-        std::uint16_t port = 8080;
+        std::string               name;
+        std::string               instance;
+        std::string               host = {"localhost"};
+        std::uint16_t             port = 8080;
+        std::vector<endpoint>     endpoints; // servers to use instead of host and port, in order of preference
+        supermon::policy          policy = supermon::policy::failover;
+        bool                      async = false; // hand messages over to the io thread instead of writing on the caller's thread
+        std::size_t               queue_size = 4096;
+        supermon::overflow        overflow = supermon::overflow::drop_oldest;
+        std::chrono::milliseconds batch_window = std::chrono::milliseconds(0); // merge pushes for this long, 0 disables batching
+        std::size_t               batch_bytes = 64 * 1024; // flush the batch early once this much data is pending
+        supermon::encoding        encoding = supermon::encoding::json; // preferred encoding, offered at login
+        std::string               metrics_channel = {"metrics"};
+        std::chrono::milliseconds metrics_interval = std::chrono::milliseconds(1000); // publish the metrics this often, 0 disables
+        double                    status_rate = 5.0; // info, alert and panic messages per second, each type on its own, 0 disables the limit
+        double                    status_burst = 20.0; // messages of a type that may be sent at once before the rate applies
+        std::chrono::milliseconds status_window = std::chrono::milliseconds(1000); // the same text again within this is only counted, 0 disables
+        std::size_t               offline_messages = 4096; // frames kept while disconnected and sent after the next login, 0 disables
+        std::size_t               offline_bytes = 16 * 1024 * 1024; // and their total size
+        std::string               spool_path; // directory to keep the offline frames in instead, survives a restart. empty keeps them in memory
+        std::size_t               spool_segment_bytes = 16 * 1024 * 1024; // size of a spool segment file, a frame has to fit into one
+        std::size_t               spool_segments = 16; // the oldest segment is dropped beyond this many
+        std::chrono::milliseconds reconnect_min = std::chrono::milliseconds(500); // first delay after losing the connection, doubles with every failed attempt
+        std::chrono::milliseconds reconnect_max = std::chrono::milliseconds(30000); // up to this, a random half of the delay is taken off
+        supermon::transport       transport = supermon::transport::websocket;
+        std::string               ring; // with transport::ring, frames go to the relay in shared memory "<ring>.out" and commands come back in "<ring>.in"
+        std::size_t               ring_bytes = 4 * 1024 * 1024; // size of each ring, frames that don't fit are dropped
+        std::chrono::microseconds ring_poll = std::chrono::microseconds(1000); // how often the io thread looks for commands from the relay
+        std::chrono::milliseconds series_interval = std::chrono::milliseconds(1000); // a bucket of every time series is appended to its channel this often, 0 disables
+        std::size_t               series_points = 64 * 1024; // samples of a time series kept at full resolution
+        std::string               series_command; // command that sends them, {"channel":..., "from":..., "to":...} in the body. none by default
+        std::size_t               stream_fragment_bytes = 64 * 1024; // agent::stream writes a frame in fragments of about this size
+        std::size_t               stream_rows = 16 * 1024; // and ends it after this many rows to let other messages through, 0 never does
+        std::string               process_channel = {"process"};
+        std::chrono::milliseconds process_interval = std::chrono::milliseconds(0); // publish the process's cpu, memory, i/o and threads from /proc this often, 0 disables
+    };
+
+    struct statistics
+    {
+        std::size_t   queued;     // messages waiting in the send queue
+        std::uint64_t sent;       // messages written to the socket
+        std::uint64_t dropped;    // messages lost to queue or offline buffer overflow
+        std::size_t   buffered;   // messages kept while disconnected or in the spool, waiting to be sent
+        std::uint64_t repeated;   // status messages folded into the repeat count of an earlier one
+        std::uint64_t suppressed; // status messages over the rate limit
     };
 
     using ptree_t = boost::property_tree::ptree;
@@ -53,14 +146,43 @@ namespace supermon
         using error      = std::function<void (const std::runtime_error&)>;
         using connect    = std::function<void ()>;
         using disconnect = std::function<void (const std::runtime_error&)>;
+        // how long the agent was offline and how many attempts it took to get back
+        using reconnect  = std::function<void (std::chrono::steady_clock::duration, std::size_t attempts)>;
         using message    = std::function<void (const std::string& tag, const ptree_ptr_t& head, const ptree_ptr_t& body)>;
         using handler    = std::function<void (const ptree_ptr_t& head, const ptree_ptr_t& body)>;
+        // head and body are views into the received frame, valid only until the handler returns
+        using command    = std::function<void (std::string_view tag, const json::value& head, const json::value& body)>;
+        // the same, answering with a result
+        using request    = std::function<supermon::result (std::string_view tag, const json::value& head, const json::value& body)>;
+#if defined(__cpp_impl_coroutine)
+        // a coroutine keeps its own copies, it outlives the frame
+        using coroutine  = std::function<supermon::task (std::string tag, ptree_ptr_t head, ptree_ptr_t body)>;
+#endif
     }
 
+    // how the commands of a tag run, see agent::on
+    struct execution
+    {
+        supermon::executor executor;        // none runs the handler on the io thread as the command is read
+        std::size_t        concurrency = 0; // commands of the tag running on the executor at once, the others wait. 0 is no limit
+        int                priority = 0;    // of the commands waiting for the executor, the highest goes first
+    };
+
     class agent final
     {
     public:
         agent(const config&);
+
+        // on an io_service of the caller's instead of one with a thread of its own. the handlers of its connections,
+        // timers and config::async sending run on whichever thread runs it, which has to be one at a time. the agent
+        // is destroyed after the io_service stopped
+        agent(const config&, boost::asio::io_service& io);
+
+        // on the session's io_service and connection, shared with the other agents of the session, see session.
+        // config::host, port, endpoints, policy and the reconnect delays are the session's. config::async, a spool
+        // and transport::ring aren't supported
+        agent(const config&, supermon::session& session);
+
         ~agent();
 
     public:
@@ -68,46 +190,263 @@ namespace supermon
         void shutdown();
 
     public:
-        void on(const std::string& tag, const callback::handler&);
+        // handlers run on the io thread unless given an executor, and a slow one holds up reading, reconnecting and
+        // every other command. with an executor the command is copied and parsed again where the handler runs, the
+        // executor has to be done with it before the agent is destroyed. a command with a trace in its head is timed
+        // from reading it until the handler has returned and the first push to the command's port went out, and the
+        // times go back to the server
+        void on(const std::string& tag, const callback::command&, const execution& how = execution());
+        void on(const std::string& tag, const callback::handler&, const execution& how = execution());
+
+        // the server gives every command an id and waits for its result until it times out. these answer with a
+        // table or an error of their own, the result goes back with the command's id and port, to whoever sent the
+        // command. handlers registered with on() and onmessage may still be sending when they return, their
+        // commands are answered as untracked then, only an error they throw counts as their result
+        void serve(const std::string& tag, const callback::request&, const execution& how = execution());
+
+#if defined(__cpp_impl_coroutine)
+        // a coroutine is started where a handler would run and answers once it co_returns, co_await post() and
+        // delay() let it wait without holding up the thread. it has to finish before the agent is destroyed, and
+        // counts against the concurrency of its executor only up to its first co_await
+        void serve(const std::string& tag, const callback::coroutine&, const execution& how = execution());
+#endif
 
         void send(const std::string& channel, const std::string& message, long port = 0);
         void send(const std::string& channel, const dataset& data, long port = 0);
         void send(const std::string& channel, const std::string& action, const dataset& data, long port = 0);
 
+        // rows of a typed_dataset, without a header: declare the channel's schema first. keyed channels
+        // don't diff them, a "replace" goes out in full
+        void send(const std::string& channel, const rowset& data, long port = 0);
+        void send(const std::string& channel, const std::string& action, const rowset& data, long port = 0);
+
+        // for tables too large to be made into one frame: the rows are written to the socket as they're serialized,
+        // a fragment of config::stream_fragment_bytes at a time, so the memory it takes doesn't grow with them. the
+        // frame ends every config::stream_rows rows to let status messages through, the rest follow as "append".
+        // the caller's thread writes, with config::async once the queue is empty. offline, with transport::ring and
+        // on the io thread it can't, the rows are sent with send() instead
+        void stream(const std::string& channel, const std::string& action, const dataset& data, long port = 0);
+        void stream(const std::string& channel, const std::string& action, const rowset& data, long port = 0);
+
+        // rows of the channel are identified by these columns. a "replace" is then sent in full only the first
+        // time and after anything may have been lost, otherwise as "insert", "update" and "delete" of the changed rows
+        void key(const std::string& channel, const std::vector<std::size_t>& columns);
+
+        // rate limited per type, see config::status_rate and config::status_window
         void info(const std::string& text);
         void alert(const std::string& text);
         void panic(const std::string& text);
 
-        void schema(const std::string& action, const ptree_t& subtree);
+        // declares the titles and types of the channel's columns, {"columns":[...],"types":[...]} in json. a schema
+        // goes to the server once per connection, with the login, and right away if connected. the server takes
+        // it over the channel's columns in schema.js and makes the channel if there is none. with transport::ring
+        // the relay keeps the first login, declare the schemas before connect()
+        void schema(const std::string& channel, std::string_view definition);
+
+        template<typename Typed>
+        void schema(const std::string& channel)
+        {
+            schema(channel, Typed::schema());
+        }
 
     public:
         boost::asio::io_service& io_service();
+        supermon::statistics stats() const;
+
+        // counters, gauges and histograms published to config::metrics_channel every config::metrics_interval
+        supermon::metrics::registry& metrics();
+
+        // samples of the channel, published as a bucket of min, max, mean and last of each column every
+        // config::series_interval. the same channel always yields the same series, valid for the agent's lifetime
+        supermon::series& series(const std::string& channel, const std::vector<std::string>& columns);
+
+        // one entry per server, in the order of config::endpoints
+        std::vector<supermon::health> health() const;
 
     private:
+        friend class session;
+
         void init();
-        void listen(std::shared_ptr<boost::asio::streambuf> buffer = nullptr);
-        void retry(std::chrono::seconds interval = std::chrono::seconds(5));
-        void dispatch(std::shared_ptr<boost::asio::streambuf>);
+        void greet(std::string& frame);
+        void opened(connection& c);
+        void closed(connection& c, const boost::system::error_code& error, bool lost);
+        void negotiate();
+        void dispatch(connection* c, char* data, std::size_t size);
+        struct route;
+        void run(const route& r, std::string& frame, std::chrono::steady_clock::time_point received);
+        void execute(const route* r, std::string_view tag, const json::value& head, const json::value& body);
+        void answer(const std::string& id, const std::string& command, long port, const supermon::result& r, bool tracked = true);
+        void install(const std::string& tag, route&& r, const execution& how);
+        void poll();
+        bool track(std::string_view tag, const json::value& head, std::chrono::steady_clock::time_point received);
+        void complete(long port);
+        void respond(long port);
+        struct trace;
+        void emit(const trace& t);
         void send(const boost::property_tree::ptree&);
+        void status(std::size_t type, const std::string& text);
+        void report(std::size_t type, const std::string& text, std::uint64_t repeat, std::uint64_t suppressed);
+        void summarize();
+        template<typename Rows>
+        void push(const std::string& channel, const std::string& action, const Rows& data, const dataset::row* header, long port, const std::vector<std::size_t>* key);
+        void publish(const std::string& channel, const dataset& data, long port, const std::vector<std::size_t>& key);
+        template<typename Rows>
+        bool fragment(const std::string& channel, const std::string& action, const Rows& data, const dataset::row* header, long port);
+        void transmit(std::string& frame, const supermon::origin& origin = supermon::origin());
+        bool write(const std::string& frame, boost::system::error_code& error);
+        bool stash(std::string& frame, const supermon::origin& origin, bool force = false);
+        bool stash(message& m, bool force = false);
+        void replay(connection& c);
+        void unspool();
+        void transfer(const std::string& frame, std::function<void (bool delivered, const boost::system::error_code&)> done);
+        void enqueue(std::string& frame, const supermon::origin& origin);
+        bool enqueue(message& m);
+        void drain();
+        void handover();
+        struct pending;
+        void batch(pending&& entry);
+        void flush();
+        void sample();
+        void probe();
+        void aggregate();
+        void points(const json::value& head, const json::value& body);
 
     public:
         callback::abort      onabort;
         callback::error      onerror;
         callback::connect    onconnect;
         callback::disconnect ondisconnect;
+        callback::reconnect  onreconnect;
         callback::message    onmessage;
 
+    private:
+        // a push waiting in the batch, datasets for the same channel/port are merged into one
+        struct pending
+        {
+            std::string channel;
+            std::string action;
+            long        port;
+            long long   when;
+            std::string key;
+            std::string header;
+            std::string rows;     // comma separated rows, or the whole serialized push for text messages
+            std::size_t count;    // number of values in rows
+            bool        text;
+            bool        binary;   // header and rows are msgpack encoded
+        };
+
+        // rate limit and repeat folding state of a status type
+        struct limiter
+        {
+            double                                tokens = 0;
+            std::chrono::steady_clock::time_point refill;
+            std::string                           text;            // last text sent
+            std::chrono::steady_clock::time_point when;            // when it was sent, starts its window
+            std::uint64_t                         repeats = 0;     // the same text since, not sent yet
+            std::uint64_t                         suppressed = 0;  // over the rate limit since the last one sent
+        };
+
+        // a command that came with head.trace, kept by its port until the trace is sent
+        struct trace
+        {
+            std::string                                     id;
+            std::string                                     command;
+            long                                            port = 0;
+            std::vector<std::pair<std::string, double>>     hops;     // stamps of the hops before this one, sent back as they came
+            std::chrono::steady_clock::time_point           received; // the frame was read
+            std::chrono::steady_clock::time_point           start;    // the handler was called
+            std::chrono::steady_clock::time_point           end;      // the handler returned, unset until then
+            std::chrono::steady_clock::time_point           respond;  // the first push to the port since, unset until then
+        };
+
+        // a handler and where it runs
+        struct route
+        {
+            callback::request                         request;
+            bool                                      tracked = false; // serve(), the request's result is the command's
+#if defined(__cpp_impl_coroutine)
+            std::shared_ptr<callback::coroutine>      coroutine; // kept by the running ones, their captures live in it
+#endif
+            supermon::executor                        executor;
+            std::shared_ptr<supermon::executor::lane> lane;
+        };
+
+        struct keyed
+        {
+            supermon::snapshot state;
+            std::uint64_t      epoch; // sessions and drops when the state was last sent, a change forces a full replace
+        };
+
     private:
         config                                                  _config;
-        boost::asio::io_service                                 _io;
+        std::unique_ptr<boost::asio::io_service>                _owned; // unless the io_service was given
+        boost::asio::io_service&                                _io;
         std::shared_ptr<boost::asio::io_service::work>          _work;
         std::future<void>                                       _result;
-        boost::asio::system_timer                               _timer;
-        boost::asio::ip::tcp::socket                            _socket;
-        beast::websocket::stream<boost::asio::ip::tcp::socket&> _websocket;
+        supermon::session*                                      _session = nullptr;
+        std::string                                             _tag; // "name.instance" on a session, in front of every frame
+        std::vector<std::shared_ptr<connection>>                _connections; // fixed once constructed, the session's one if on a session
+        std::size_t                                             _active = 0; // the one in use with failover
+        std::size_t                                             _failed = 0; // servers failed in a row with failover
+        std::size_t                                             _attempts = 0; // failed since the agent was last connected
+        std::chrono::steady_clock::time_point                   _lost; // when the agent lost its last connection, unset while connected
         std::chrono::time_point<std::chrono::system_clock>      _when = std::chrono::system_clock::now();
-        std::map<std::string, callback::handler>                _handlers;
-        std::mutex                                              _write_lock;
+        std::vector<std::pair<std::string, route>>              _handlers; // sorted by tag
+        json::document                                          _document;
+        std::atomic<bool>                                       _connected = {false}; // any server
+        std::atomic<bool>                                       _binary = {false}; // every server connected accepted msgpack
+        std::thread::id                                         _io_thread;
+        supermon::queue<message>                                _queue;
+        std::atomic<bool>                                       _draining = {false};
+        std::atomic<bool>                                       _stream_waiting = {false}; // drain() gives the socket up between frames
+        std::mutex                                              _handover_lock;
+        std::condition_variable                                 _handover; // the waiting stream, woken when _draining is let go
+        message                                                 _outgoing;
+        mutable std::mutex                                      _backlog_lock;
+        supermon::backlog                                       _backlog;
+        std::unique_ptr<supermon::spool>                        _spool;
+        std::atomic<bool>                                       _spooling = {false}; // frames go to the spool until it's been sent
+        std::string                                             _spooled; // frame of the spool being written
+        bool                                                    _unspooling = false;
+        std::atomic<std::uint64_t>                              _sent = {0};
+        std::atomic<std::uint64_t>                              _dropped = {0};
+        boost::asio::steady_timer                               _flush_timer;
+        std::mutex                                              _batch_lock;
+        std::vector<pending>                                    _batch;
+        std::map<std::pair<std::string, long>, std::size_t>     _coalesce;
+        std::size_t                                             _batch_bytes = 0;
+        std::mutex                                              _keyed_lock;
+        std::map<std::string, std::vector<std::size_t>>         _keys;
+        std::map<std::pair<std::string, long>, keyed>           _snapshots;
+        std::atomic<std::uint64_t>                              _sessions = {0};
+        supermon::metrics::registry                             _metrics;
+        boost::asio::steady_timer                               _metrics_timer;
+        std::chrono::steady_clock::time_point                   _metrics_when;
+        supermon::dataset                                       _metrics_data;
+        std::mutex                                              _status_lock;
+        limiter                                                 _limiters[3]; // info, alert, panic
+        boost::asio::steady_timer                               _status_timer;
+        std::atomic<std::uint64_t>                              _repeated = {0};
+        std::atomic<std::uint64_t>                              _suppressed = {0};
+        std::mutex                                              _trace_lock;
+        std::map<long, trace>                                   _traces; // by port
+        std::atomic<std::size_t>                                _tracing = {0}; // size of _traces, untraced pushes look at this only
+        std::unique_ptr<supermon::ring>                         _outbound; // to the relay with transport::ring, instead of the connections
+        std::unique_ptr<supermon::ring>                         _inbound;
+        std::atomic_flag                                        _outbound_lock = ATOMIC_FLAG_INIT; // publishers take turns, the ring has one writer
+        boost::asio::steady_timer                               _poll_timer;
+        std::string                                             _inbound_frame;
+        std::mutex                                              _series_lock;
+        std::vector<std::pair<std::string, std::unique_ptr<supermon::series>>> _series;
+        boost::asio::steady_timer                               _series_timer;
+        supermon::dataset                                       _series_data;
+        std::mutex                                              _schema_lock;
+        std::map<std::string, std::string>                      _schemas; // by channel
+        std::mutex                                              _stream_lock; // one fragmented frame at a time
+        std::unique_ptr<supermon::telemetry>                    _telemetry;
+        boost::asio::steady_timer                               _telemetry_timer;
+        std::chrono::steady_clock::time_point                   _telemetry_when;
+        supermon::dataset                                       _telemetry_data;
     };
 
 }
@@ -0,0 +1,130 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_backlog_h
+#define supermon_backlog_h
+
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <cstddef>
+
+namespace supermon
+{
+
+    // what a frame holds, as far as the backlog cares
+    struct origin
+    {
+        const std::string* channel = nullptr; // set for a snapshot of the channel: a replace or a delta on top of one
+        long               port = 0;
+        bool               replace = false;
+    };
+
+    // a serialized frame on its way to the socket
+    struct message
+    {
+        std::string frame;
+        std::string channel; // empty unless the frame is a snapshot, see origin
+        long        port = 0;
+        bool        replace = false;
+
+        void assign(const supermon::origin& origin)
+        {
+            if (nullptr != origin.channel) channel = *origin.channel;
+            else channel.clear();
+            port = origin.port;
+            replace = origin.replace;
+        }
+    };
+
+    // frames sent while disconnected, bounded by count and bytes, the oldest go first when full.
+    // a newer replace of a channel supersedes the one kept before and the deltas made on top of it.
+    // not synchronized, the agent holds a lock around it
+    class backlog
+    {
+    public:
+        backlog(std::size_t messages, std::size_t bytes) : _max_messages(messages), _max_bytes(bytes)
+        {
+        }
+
+    public:
+        // takes over the frame's contents, returns the number of frames lost to make room
+        std::size_t push(message& m)
+        {
+            std::size_t lost = 0;
+
+            if (m.replace)
+            {
+                const auto it = std::remove_if(_messages.begin(), _messages.end(), [this, &m](const message& kept)
+                {
+                    if (kept.channel.empty() || kept.port != m.port || kept.channel != m.channel) return false;
+                    _bytes -= kept.frame.size();
+                    return true;
+                });
+                _messages.erase(it, _messages.end());
+            }
+
+            if (m.frame.size() > _max_bytes || 0 == _max_messages)
+            {
+                return 1;
+            }
+
+            while (_messages.size() >= _max_messages || _bytes + m.frame.size() > _max_bytes)
+            {
+                _bytes -= _messages.front().frame.size();
+                _messages.pop_front();
+                ++lost;
+            }
+
+            _bytes += m.frame.size();
+            _messages.emplace_back();
+            std::swap(_messages.back(), m);
+            return lost;
+        }
+
+        // hands the frames to f in the order they were pushed until it returns false,
+        // the frame it failed on and the ones after it are kept
+        template<typename F>
+        void replay(F&& f)
+        {
+            while (!_messages.empty())
+            {
+                if (!f(_messages.front().frame)) return;
+                _bytes -= _messages.front().frame.size();
+                _messages.pop_front();
+            }
+        }
+
+        std::size_t size() const
+        {
+            return _messages.size();
+        }
+
+        std::size_t bytes() const
+        {
+            return _bytes;
+        }
+
+    private:
+        const std::size_t   _max_messages;
+        const std::size_t   _max_bytes;
+        std::deque<message> _messages;
+        std::size_t         _bytes = 0;
+    };
+
+}
+
+#endif
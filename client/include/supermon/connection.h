@@ -0,0 +1,160 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_connection_h
+#define supermon_connection_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <optional>
+#include <cstdint>
+#include <functional>
+
+#include "boost/asio.hpp"
+#include "boost/asio/steady_timer.hpp"
+
+#include "beast/websocket.hpp"
+
+namespace supermon
+{
+
+    struct endpoint
+    {
+        std::string   host = {"localhost"};
+        std::uint16_t port = 8080;
+    };
+
+    // how the connection to one server is doing
+    struct health
+    {
+        supermon::endpoint                    endpoint;
+        bool                                  connected;
+        std::uint64_t                         sent;     // frames written
+        std::uint64_t                         failed;   // frames that failed to write
+        std::uint64_t                         logins;   // times it connected and logged in
+        std::uint64_t                         errors;   // attempts that failed before the login
+        std::uint64_t                         lost;     // connections lost after the login
+        std::chrono::steady_clock::duration   downtime; // from losing the connection to the next login, the last time
+    };
+
+    // the websocket to one server and the steps of getting it up: resolve, connect, handshake and login,
+    // all asynchronous on the io thread. what happens after a failure is up to the owner
+    class connection final
+    {
+    public:
+        connection(boost::asio::io_service& io, const supermon::endpoint& endpoint, std::chrono::milliseconds backoff_min, std::chrono::milliseconds backoff_max);
+
+        connection(const connection&) = delete;
+        connection& operator=(const connection&) = delete;
+
+    public:
+        // starts connecting right away
+        void open();
+
+        // starts connecting after the backoff, which doubles with every call until the next login.
+        // a random half of it is taken off, so agents that lost the same server don't come back in lockstep
+        void retry();
+
+        // false on a socket error, safe to call from any thread. a tag goes in front of the frame's members as
+        // "@", for the server to tell apart the agents sharing the connection, see session
+        bool write(const std::string& frame, boost::system::error_code& error, std::string_view tag = std::string_view());
+
+        // a fragment of a frame that's written as it's made, see agent::stream. the first one takes the connection
+        // until the last one, fin, has been written, other writes wait meanwhile. false on a socket error, which ends
+        // the frame. one frame at a time, the caller keeps the others out
+        bool write_some(bool fin, const std::string& fragment, bool binary, boost::system::error_code& error, std::string_view tag = std::string_view());
+
+        // {"@":"<tag>", or its msgpack counterpart, to be followed by the frame without its first byte
+        static void tagged(std::string& prefix, const std::string& frame, std::string_view tag);
+
+        // io thread only, one at a time
+        void async_write(const std::string& frame, std::function<void (const boost::system::error_code&)> handler);
+
+        bool connected() const
+        {
+            return _connected;
+        }
+
+        // whether the server took the msgpack encoding offered at login
+        bool binary() const
+        {
+            return _binary;
+        }
+
+        void binary(bool accepted)
+        {
+            _binary = accepted;
+        }
+
+        const supermon::endpoint& endpoint() const
+        {
+            return _endpoint;
+        }
+
+        supermon::health health() const;
+
+    public:
+        // all called on the io thread
+        std::function<void (std::string& frame)>                                      greet;   // writes the login
+        std::function<void (connection&)>                                             onopen;  // the login went out
+        std::function<void (connection&, const boost::system::error_code&, bool lost)> onclose; // an attempt failed, or the connection went away if lost
+        std::function<void (connection&, char* data, std::size_t size)>               onframe; // the data is valid until the handler returns
+
+    private:
+        using websocket = beast::websocket::stream<boost::asio::ip::tcp::socket&>;
+
+        void resolve();
+        void dial();
+        void handshake();
+        void login();
+        void listen();
+        void fail(const boost::system::error_code& error, bool lost);
+
+    private:
+        const supermon::endpoint                                _endpoint;
+        const std::chrono::milliseconds                         _backoff_min;
+        const std::chrono::milliseconds                         _backoff_max;
+        std::minstd_rand                                        _random;
+        std::size_t                                             _attempts = 0; // retries since the last login
+        boost::asio::steady_timer                               _timer;
+        boost::asio::ip::tcp::resolver                          _resolver;
+        std::vector<boost::asio::ip::tcp::endpoint>             _endpoints; // resolved once, again only after connecting to all of them failed
+        boost::asio::ip::tcp::socket                            _socket;
+        std::optional<websocket>                                _websocket; // made anew for every attempt, a failed stream stays failed
+        boost::asio::streambuf                                  _buffer;
+        std::string                                             _login;
+        std::string                                             _prefix; // of the tagged frame being written
+        std::mutex                                              _write_lock;
+        bool                                                    _fragmented = false; // _write_lock is held by write_some until fin
+        std::atomic<bool>                                       _connected = {false};
+        std::atomic<bool>                                       _binary = {false};
+        std::chrono::steady_clock::time_point                   _down; // when the connection was lost, unset until then
+        std::atomic<std::uint64_t>                              _sent = {0};
+        std::atomic<std::uint64_t>                              _failed = {0};
+        std::atomic<std::uint64_t>                              _logins = {0};
+        std::atomic<std::uint64_t>                              _errors = {0};
+        std::atomic<std::uint64_t>                              _lost = {0};
+        std::atomic<std::chrono::steady_clock::rep>             _downtime = {0};
+    };
+
+}
+
+#endif
@@ -19,10 +19,14 @@
 
 #include <vector>
 #include <string>
-#include <functional>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+#include <cstring>
 #include <type_traits>
+#include <string_view>
 
-#include "boost/algorithm/string/replace.hpp"
+#include "supermon/json.h"
 
 namespace supermon
 {
@@ -30,46 +34,148 @@ namespace supermon
     class dataset
     {
     public:
-        class row : public std::vector<std::function<std::ostream& (std::ostream&)>>
+        // a single typed value, strings live in the arena of the owning storage
+        struct cell
+        {
+            enum class type : std::uint8_t { null, boolean, int64, uint64, float32, float64, string };
+
+            type kind;
+            union
+            {
+                bool               b;
+                long long          i;
+                unsigned long long u;
+                float              f;
+                double             d;
+                struct
+                {
+                    std::uint32_t offset;
+                    std::uint32_t length;
+                } s;
+            };
+        };
+
+        // cells of all rows back to back plus one contiguous arena for their strings
+        struct storage
+        {
+            std::vector<cell> cells;
+            std::string       arena;
+
+            void clear()
+            {
+                cells.clear();
+                arena.clear();
+            }
+        };
+
+        class row
         {
+        public:
+            row() = default;
+
+            row(const row& other) : _storage(other._storage), _first(other._first), _count(other._count)
+            {
+                if (other._own)
+                {
+                    _own.reset(new storage(*other._own));
+                    _storage = _own.get();
+                }
+            }
+
+            row(row&& other) : _storage(other._storage), _own(std::move(other._own)), _first(other._first), _count(other._count)
+            {
+                other._storage = nullptr;
+                other._first = other._count = 0;
+            }
+
+            row& operator=(const row& other)
+            {
+                if (this != &other)
+                {
+                    row copy(other);
+                    *this = std::move(copy);
+                }
+                return *this;
+            }
+
+            row& operator=(row&& other)
+            {
+                if (this != &other)
+                {
+                    _storage = other._storage;
+                    _own = std::move(other._own);
+                    _first = other._first;
+                    _count = other._count;
+                    other._storage = nullptr;
+                    other._first = other._count = 0;
+                }
+                return *this;
+            }
+
         public:
             template<typename T>
-            typename std::enable_if<std::is_arithmetic<typename std::decay<T>::type>::value ||
-                                    std::is_same<bool, typename std::decay<T>::type>::value>::type
+            typename std::enable_if<std::is_arithmetic<typename std::decay<T>::type>::value>::type
             add(T&& value)
             {
-                emplace_back
-                (
-                    [value](std::ostream& os) -> std::ostream&
-                    {
-                        os << std::boolalpha << value;
-                        return os;
-                    }
-                );
+                using type = typename std::decay<T>::type;
+
+                cell& c = append();
+                if (std::is_same<bool, type>::value)
+                {
+                    c.kind = cell::type::boolean;
+                    c.b = static_cast<bool>(value);
+                }
+                else if (std::is_same<char, type>::value)
+                {
+                    // a plain char is text, signed and unsigned chars are numbers
+                    char ch = static_cast<char>(value);
+                    assign(c, &ch, 1);
+                }
+                else if (std::is_same<float, type>::value)
+                {
+                    c.kind = cell::type::float32;
+                    c.f = static_cast<float>(value);
+                }
+                else if (std::is_floating_point<type>::value)
+                {
+                    c.kind = cell::type::float64;
+                    c.d = static_cast<double>(value);
+                }
+                else if (std::is_signed<type>::value)
+                {
+                    c.kind = cell::type::int64;
+                    c.i = static_cast<long long>(value);
+                }
+                else
+                {
+                    c.kind = cell::type::uint64;
+                    c.u = static_cast<unsigned long long>(value);
+                }
             }
 
             void add(const std::string& value)
             {
-                emplace_back
-                (
-                    [value = boost::algorithm::replace_all_copy(value, "\"", "\\\"")](std::ostream& os) -> std::ostream&
-                    {
-                        os << '"' << value << '"';
-                        return os;
-                    }
-                );
+                assign(append(), value.data(), value.size());
+            }
+
+            void add(std::string_view value)
+            {
+                assign(append(), value.data(), value.size());
+            }
+
+            void add(const char* value)
+            {
+                if (nullptr == value)
+                {
+                    add(nullptr);
+                    return;
+                }
+                assign(append(), value, std::strlen(value));
             }
 
             void add(std::nullptr_t)
             {
-                emplace_back
-                (
-                    [](std::ostream& os) -> std::ostream&
-                    {
-                        os << "null";
-                        return os;
-                    }
-                );
+                append().kind = cell::type::null;
             }
 
             template<typename ...ARGS>
@@ -93,56 +199,249 @@ namespace supermon
                 return r;
             }
 
+        public:
+            std::size_t size() const
+            {
+                return _count;
+            }
+
+            bool empty() const
+            {
+                return 0 == _count;
+            }
+
+            const cell* begin() const
+            {
+                return nullptr != _storage ? _storage->cells.data() + _first : nullptr;
+            }
+
+            const cell* end() const
+            {
+                return begin() + _count;
+            }
+
+            const char* text(const cell& c) const
+            {
+                return _storage->arena.data() + c.s.offset;
+            }
+
+            // the cells of a dataset's row stay in its storage until the dataset is cleared
+            void clear()
+            {
+                if (_own) _own->clear();
+                _count = 0;
+                _first = 0;
+            }
+
+            template<typename Writer>
+            void write(Writer& w) const
+            {
+                w.begin_array(_count);
+                for (const auto& c : *this)
+                {
+                    switch (c.kind)
+                    {
+                        case cell::type::null:    w.value(nullptr); break;
+                        case cell::type::boolean: w.value(c.b); break;
+                        case cell::type::int64:   w.value(c.i); break;
+                        case cell::type::uint64:  w.value(c.u); break;
+                        case cell::type::float32: w.value(c.f); break;
+                        case cell::type::float64: w.value(c.d); break;
+                        case cell::type::string:  w.value(std::string_view(text(c), c.s.length)); break;
+                    }
+                }
+                w.end_array();
+            }
+
             friend std::ostream& operator<<(std::ostream& os, const row& r)
             {
-                os << "[";
-                bool first = true;
-                for (const auto& cell : r)
+                std::string buffer;
+                json::writer w(buffer);
+                r.write(w);
+                return os << buffer;
+            }
+
+        private:
+            friend class dataset;
+
+            explicit row(storage* s) : _storage(s), _first(static_cast<std::uint32_t>(s->cells.size()))
+            {
+            }
+
+            cell& append()
+            {
+                if (nullptr == _storage)
                 {
-                    if (!first) os << ",";
-                    else first = false;
-                    cell(os);
+                    _own.reset(new storage());
+                    _storage = _own.get();
                 }
-                os << "]";
-                return os;
+
+                auto& cells = _storage->cells;
+                if (_first + _count != cells.size())
+                {
+                    // another row was appended after this one, move our cells to the end
+                    std::size_t first = cells.size();
+                    cells.reserve(first + _count + 1);
+                    for (std::size_t n = 0; n < _count; ++n)
+                    {
+                        cells.push_back(cells[_first + n]);
+                    }
+                    _first = static_cast<std::uint32_t>(first);
+                }
+
+                ++_count;
+                cells.emplace_back();
+                return cells.back();
+            }
+
+            void assign(cell& c, const char* data, std::size_t length)
+            {
+                c.kind = cell::type::string;
+                c.s.offset = static_cast<std::uint32_t>(_storage->arena.size());
+                c.s.length = static_cast<std::uint32_t>(length);
+                _storage->arena.append(data, length);
             }
+
+        private:
+            storage*                 _storage = nullptr;
+            std::unique_ptr<storage> _own;
+            std::uint32_t            _first = 0;
+            std::uint32_t            _count = 0;
         };
 
+    public:
+        dataset() = default;
+
+        dataset(const dataset& other) : header(other.header), _storage(other._storage), _rows(other._rows)
+        {
+            rebind();
+        }
+
+        dataset& operator=(const dataset& other)
+        {
+            if (this != &other)
+            {
+                header = other.header;
+                _storage = other._storage;
+                _rows = other._rows;
+                rebind();
+            }
+            return *this;
+        }
+
+        dataset(dataset&& other) : header(std::move(other.header)), _storage(std::move(other._storage)), _rows(std::move(other._rows))
+        {
+            rebind();
+        }
+
+        dataset& operator=(dataset&& other)
+        {
+            header = std::move(other.header);
+            _storage = std::move(other._storage);
+            _rows = std::move(other._rows);
+            rebind();
+            return *this;
+        }
+
     public:
         template<typename ...ARGS>
         void insert(ARGS&& ...args)
         {
-            row& r = *(_rows.emplace(_rows.end()));
+            row& r = insertRow();
             r.add_pack(std::forward<ARGS>(args)...);
         }
 
         row& insertRow()
         {
-            return *(_rows.emplace(_rows.end()));
+            _rows.emplace_back(row(&_storage));
+            return _rows.back();
+        }
+
+        // copies the values of a row of another dataset
+        row& insertRow(const row& source)
+        {
+            row& r = insertRow();
+            for (const auto& c : source)
+            {
+                if (cell::type::string == c.kind)
+                {
+                    r.add(std::string_view(source.text(c), c.s.length));
+                }
+                else
+                {
+                    r.append() = c;
+                }
+            }
+            return r;
+        }
+
+        std::size_t size() const
+        {
+            return _rows.size();
+        }
+
+        std::vector<row>::const_iterator begin() const
+        {
+            return _rows.begin();
+        }
+
+        std::vector<row>::const_iterator end() const
+        {
+            return _rows.end();
+        }
+
+        // drops the rows but keeps the header and the allocated memory, so a dataset
+        // reused for every publish stops allocating once it has seen its largest size
+        void clear()
+        {
+            _rows.clear();
+            _storage.clear();
+        }
+
+        void reserve(std::size_t rows, std::size_t cells = 0, std::size_t bytes = 0)
+        {
+            _rows.reserve(rows);
+            _storage.cells.reserve(cells);
+            _storage.arena.reserve(bytes);
         }
 
     public:
+        template<typename Writer>
+        void write(Writer& w) const
+        {
+            w.begin_array(_rows.size());
+            for (const auto& row : _rows)
+            {
+                row.write(w);
+            }
+            w.end_array();
+        }
+
         friend std::ostream& operator<<(std::ostream& os, const dataset& data)
         {
-            os << "[";
-            bool first = true;
-            for (const auto& row : data._rows)
+            std::string buffer;
+            json::writer w(buffer);
+            data.write(w);
+            return os << buffer;
+        }
+
+    private:
+        void rebind()
+        {
+            for (auto& row : _rows)
             {
-                if (!first) os << ",";
-                else first = false;
-                os << row;
+                row._storage = &_storage;
             }
-            os << "]";
-            return os;
         }
 
     public:
         row header;
 
     private:
+        storage          _storage;
         std::vector<row> _rows;
     };
-    
+
 }
 
 #endif
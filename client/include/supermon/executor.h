@@ -0,0 +1,99 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_executor_h
+#define supermon_executor_h
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace supermon
+{
+
+    // somewhere for command handlers to run other than the agent's io thread, see agent::on. copies are the
+    // same executor: the commands of every handler using it wait in one queue and are handed to the underlying
+    // context one at a time as it gets to them, the waiting command of the highest priority first. so a command
+    // posted behind a pile of slow ones still runs next, as long as the context doesn't run them all at once
+    class executor
+    {
+    public:
+        using post_type = std::function<void (std::function<void ()>)>;
+
+        // the commands of one handler
+        struct lane
+        {
+            std::size_t concurrency = 0; // running at once, 0 is no limit
+            int         priority = 0;
+            std::size_t running = 0;     // guarded by the executor
+        };
+
+        // none, handlers run on the io thread
+        executor() = default;
+
+        // post has to run the function it's given sometime later, on any thread
+        explicit executor(post_type post);
+
+        // anything with post(): an io_service, or a strand of one. an io_service run by several threads is a pool
+        template<typename Context>
+        static executor of(Context& context)
+        {
+            return executor([&context](std::function<void ()> f)
+            {
+                context.post(std::move(f));
+            });
+        }
+
+        explicit operator bool() const
+        {
+            return static_cast<bool>(_state);
+        }
+
+    public:
+        // the job runs once its lane has room and nothing of a higher priority is waiting
+        void submit(const std::shared_ptr<lane>& l, std::function<void ()> job);
+
+        // commands queued and not started yet
+        std::size_t waiting() const;
+
+    private:
+        struct job
+        {
+            std::shared_ptr<lane>  handler;
+            std::function<void ()> run;
+        };
+
+        struct state
+        {
+            post_type                                         post;
+            std::mutex                                        lock;
+            std::map<std::pair<int, std::uint64_t>, job>      waiting;  // by negated priority, then arrival
+            std::uint64_t                                     sequence = 0;
+        };
+
+        static void pump(const std::shared_ptr<state>& s);
+
+    private:
+        std::shared_ptr<state> _state;
+    };
+
+}
+
+#endif
@@ -0,0 +1,552 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_json_h
+#define supermon_json_h
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace supermon
+{
+    namespace json
+    {
+
+        // appends the escaped form of the string, without the quotes
+        inline void escape(std::string& out, std::string_view text)
+        {
+            static const char hex[] = "0123456789abcdef";
+
+            const char* s = text.data();
+            const char* e = s + text.size();
+
+            while (s != e)
+            {
+                // skip the longest run of characters that don't need escaping
+                const char* run = s;
+#if defined(__SSE2__)
+                const __m128i quote = _mm_set1_epi8('"');
+                const __m128i slash = _mm_set1_epi8('\\');
+                const __m128i space = _mm_set1_epi8(0x1f);
+                while (16 <= e - run)
+                {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(run));
+                    const __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v); // unsigned v <= 0x1f
+                    const __m128i special = _mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)));
+                    const int mask = _mm_movemask_epi8(special);
+                    if (0 != mask)
+                    {
+                        run += __builtin_ctz(static_cast<unsigned>(mask));
+                        break;
+                    }
+                    run += 16;
+                }
+                // the scalar loop takes care of the tail, or stops right away at the character found above
+#endif
+                while (run != e)
+                {
+                    const unsigned char c = static_cast<unsigned char>(*run);
+                    if (c < 0x20 || '"' == c || '\\' == c) break;
+                    ++run;
+                }
+                out.append(s, run - s);
+                if (run == e) break;
+
+                const unsigned char c = static_cast<unsigned char>(*run);
+                switch (c)
+                {
+                    case '"':  out.append("\\\"", 2); break;
+                    case '\\': out.append("\\\\", 2); break;
+                    case '\b': out.append("\\b", 2); break;
+                    case '\f': out.append("\\f", 2); break;
+                    case '\n': out.append("\\n", 2); break;
+                    case '\r': out.append("\\r", 2); break;
+                    case '\t': out.append("\\t", 2); break;
+                    default:
+                        {
+                            const char u[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+                            out.append(u, sizeof(u));
+                        }
+                        break;
+                }
+                s = run + 1;
+            }
+        }
+
+        // streaming JSON writer, appends straight into a caller owned buffer
+        // so the same buffer can be reused from message to message
+        class writer
+        {
+        public:
+            explicit writer(std::string& buffer) : _buffer(buffer)
+            {
+            }
+
+        public:
+            writer& begin_object()
+            {
+                separate();
+                _buffer += '{';
+                push();
+                return *this;
+            }
+
+            // the count is only needed by binary encodings, see msgpack::writer
+            writer& begin_object(std::size_t /*count*/)
+            {
+                return begin_object();
+            }
+
+            writer& end_object()
+            {
+                pop();
+                _buffer += '}';
+                return *this;
+            }
+
+            writer& begin_array()
+            {
+                separate();
+                _buffer += '[';
+                push();
+                return *this;
+            }
+
+            writer& begin_array(std::size_t /*count*/)
+            {
+                return begin_array();
+            }
+
+            writer& end_array()
+            {
+                pop();
+                _buffer += ']';
+                return *this;
+            }
+
+            writer& key(std::string_view name)
+            {
+                separate();
+                quote(name);
+                _buffer += ':';
+                _key = true;
+                return *this;
+            }
+
+            writer& value(std::string_view text)
+            {
+                separate();
+                quote(text);
+                return *this;
+            }
+
+            writer& value(const char* text)
+            {
+                return nullptr != text ? value(std::string_view(text)) : value(nullptr);
+            }
+
+            writer& value(const std::string& text)
+            {
+                return value(std::string_view(text));
+            }
+
+            writer& value(bool flag)
+            {
+                separate();
+                if (flag) _buffer.append("true", 4);
+                else _buffer.append("false", 5);
+                return *this;
+            }
+
+            writer& value(std::nullptr_t)
+            {
+                separate();
+                _buffer.append("null", 4);
+                return *this;
+            }
+
+            writer& value(long long number)
+            {
+                separate();
+                return format(number);
+            }
+
+            writer& value(unsigned long long number)
+            {
+                separate();
+                return format(number);
+            }
+
+            writer& value(int number)                { return value(static_cast<long long>(number)); }
+            writer& value(long number)               { return value(static_cast<long long>(number)); }
+            writer& value(unsigned int number)       { return value(static_cast<unsigned long long>(number)); }
+            writer& value(unsigned long number)      { return value(static_cast<unsigned long long>(number)); }
+
+            // shortest representation that reads back to the same value, JSON has no NaN or infinity
+            writer& value(double number)
+            {
+                separate();
+                if (!std::isfinite(number))
+                {
+                    _buffer.append("null", 4);
+                    return *this;
+                }
+                return format(number);
+            }
+
+            writer& value(float number)
+            {
+                separate();
+                if (!std::isfinite(number))
+                {
+                    _buffer.append("null", 4);
+                    return *this;
+                }
+                return format(number);
+            }
+
+            // a number written as a string, which is how the server has always received timestamps and ports
+            writer& quoted(long long number)
+            {
+                separate();
+                _buffer += '"';
+                format(number);
+                _buffer += '"';
+                return *this;
+            }
+
+            // already serialized JSON, one or more comma separated values
+            writer& raw(std::string_view json, std::size_t /*count*/ = 1)
+            {
+                separate();
+                _buffer.append(json.data(), json.size());
+                return *this;
+            }
+
+            std::string& buffer()
+            {
+                return _buffer;
+            }
+
+        private:
+            template<typename T>
+            writer& format(T number)
+            {
+                char digits[32];
+                auto result = std::to_chars(digits, digits + sizeof(digits), number);
+                _buffer.append(digits, result.ptr - digits);
+                return *this;
+            }
+
+            void quote(std::string_view text)
+            {
+                _buffer += '"';
+                escape(_buffer, text);
+                _buffer += '"';
+            }
+
+            // one bit per nesting level, set once the level has its first element
+            void separate()
+            {
+                if (_key)
+                {
+                    _key = false;
+                    return;
+                }
+                const std::uint64_t bit = std::uint64_t(1) << (_depth & 63);
+                if (_elements & bit) _buffer += ',';
+                else _elements |= bit;
+            }
+
+            void push()
+            {
+                ++_depth;
+                _elements &= ~(std::uint64_t(1) << (_depth & 63));
+            }
+
+            void pop()
+            {
+                --_depth;
+            }
+
+        private:
+            std::string&  _buffer;
+            std::uint64_t _elements = 0;
+            unsigned      _depth = 0;
+            bool          _key = false;
+        };
+
+        class error : public std::runtime_error
+        {
+        public:
+            error(const std::string& what, std::size_t offset) : std::runtime_error("json: " + what + " at offset " + std::to_string(offset)), _offset(offset)
+            {
+            }
+
+            std::size_t offset() const
+            {
+                return _offset;
+            }
+
+        private:
+            std::size_t _offset;
+        };
+
+        class value;
+
+        // parses a message in place: strings are unescaped inside the text itself, so the text must outlive
+        // the values handed out by root(). tokens are kept between parses, a reused document doesn't allocate
+        class document
+        {
+        public:
+            enum class type : std::uint8_t { null, boolean, number, string, array, object };
+
+            void parse(char* text, std::size_t size);
+            // same for a MessagePack encoded message, strings are views into the data (msgpack.cpp)
+            void unpack(const char* data, std::size_t size);
+            value root() const;
+
+        private:
+            friend class value;
+
+            // subtrees are flattened in document order, an object's members are key/value token pairs
+            struct token
+            {
+                type             kind;
+                bool             integral;
+                std::uint32_t    size; // members of an object, elements of an array
+                std::uint32_t    next; // first token after this subtree
+                std::string_view text; // string contents or the number as written
+                union
+                {
+                    long long    i;
+                    double       d;
+                    bool         b;
+                };
+            };
+
+            std::vector<token> _tokens;
+            std::string        _numbers; // text of unpacked numbers, parsed JSON has it in place
+        };
+
+        // read-only view of a parsed value, valid until the document is parsed again
+        class value
+        {
+        public:
+            using type = document::type;
+
+            value() = default;
+
+        public:
+            explicit operator bool() const
+            {
+                return nullptr != _document;
+            }
+
+            type kind() const
+            {
+                return token().kind;
+            }
+
+            bool is_null() const   { return type::null == kind(); }
+            bool is_object() const { return type::object == kind(); }
+            bool is_array() const  { return type::array == kind(); }
+            bool is_string() const { return type::string == kind(); }
+            bool is_number() const { return type::number == kind(); }
+
+            std::size_t size() const
+            {
+                return nullptr != _document ? token().size : 0;
+            }
+
+            // missing members yield an empty value instead of throwing
+            value operator[](std::string_view key) const
+            {
+                if (nullptr == _document || type::object != token().kind) return value();
+
+                const auto& tokens = _document->_tokens;
+                std::uint32_t index = _index + 1;
+                for (std::uint32_t n = 0; n < token().size; ++n)
+                {
+                    if (tokens[index].text == key) return value(_document, index + 1);
+                    index = tokens[index + 1].next;
+                }
+                return value();
+            }
+
+            value operator[](std::size_t position) const
+            {
+                if (nullptr == _document || type::array != token().kind || position >= token().size) return value();
+
+                const auto& tokens = _document->_tokens;
+                std::uint32_t index = _index + 1;
+                for (std::size_t n = 0; n < position; ++n)
+                {
+                    index = tokens[index].next;
+                }
+                return value(_document, index);
+            }
+
+            // dotted paths, like property_tree: head.get<long>("port")
+            value find(std::string_view path) const
+            {
+                value result = *this;
+                while (result)
+                {
+                    auto dot = path.find('.');
+                    result = result[path.substr(0, dot)];
+                    if (std::string_view::npos == dot) break;
+                    path.remove_prefix(dot + 1);
+                }
+                return result;
+            }
+
+            // calls f(name, value) for every member of an object or f("", value) for every element of an array
+            template<typename F>
+            void for_each(F&& f) const
+            {
+                if (nullptr == _document) return;
+
+                const auto& t = token();
+                if (type::object != t.kind && type::array != t.kind) return;
+
+                const auto& tokens = _document->_tokens;
+                std::uint32_t index = _index + 1;
+                for (std::uint32_t n = 0; n < t.size; ++n)
+                {
+                    std::string_view name;
+                    if (type::object == t.kind)
+                    {
+                        name = tokens[index].text;
+                        ++index;
+                    }
+                    f(name, value(_document, index));
+                    index = tokens[index].next;
+                }
+            }
+
+            // the text of a scalar as property_tree would have stored it
+            std::string_view str() const
+            {
+                const auto& t = token();
+                switch (t.kind)
+                {
+                    case type::null:    return "null";
+                    case type::boolean: return t.b ? "true" : "false";
+                    case type::number:
+                    case type::string:  return t.text;
+                    default:            return std::string_view();
+                }
+            }
+
+            template<typename T>
+            T as() const
+            {
+                const auto& t = token();
+
+                if constexpr (std::is_same<T, std::string>::value)
+                {
+                    return std::string(str());
+                }
+                else if constexpr (std::is_same<T, std::string_view>::value)
+                {
+                    return str();
+                }
+                else if constexpr (std::is_same<T, bool>::value)
+                {
+                    if (type::boolean == t.kind) return t.b;
+                    if (type::number == t.kind) return t.integral ? 0 != t.i : 0 != t.d;
+                    if (type::string == t.kind && ("true" == t.text || "false" == t.text)) return "true" == t.text;
+                    throw std::invalid_argument("json: value is not a boolean");
+                }
+                else if constexpr (std::is_arithmetic<T>::value)
+                {
+                    if (type::number == t.kind) return t.integral ? static_cast<T>(t.i) : static_cast<T>(t.d);
+                    if (type::string == t.kind)
+                    {
+                        // numbers often travel as strings, e.g. ports and timestamps
+                        T result = T();
+                        auto r = std::from_chars(t.text.data(), t.text.data() + t.text.size(), result);
+                        if (std::errc() == r.ec && r.ptr == t.text.data() + t.text.size()) return result;
+                    }
+                    throw std::invalid_argument("json: value is not a number");
+                }
+                else
+                {
+                    static_assert(std::is_arithmetic<T>::value, "unsupported type");
+                }
+            }
+
+            template<typename T>
+            T get(std::string_view path) const
+            {
+                value v = find(path);
+                if (!v) throw std::out_of_range("json: no such value '" + std::string(path) + "'");
+                return v.as<T>();
+            }
+
+            template<typename T>
+            T get(std::string_view path, const T& fallback) const
+            {
+                value v = find(path);
+                if (!v) return fallback;
+                try
+                {
+                    return v.as<T>();
+                }
+                catch (const std::exception&)
+                {
+                    return fallback;
+                }
+            }
+
+        private:
+            friend class document;
+
+            value(const document* owner, std::uint32_t index) : _document(owner), _index(index)
+            {
+            }
+
+            const document::token& token() const
+            {
+                if (nullptr == _document) throw std::out_of_range("json: no such value");
+                return _document->_tokens[_index];
+            }
+
+        private:
+            const document* _document = nullptr;
+            std::uint32_t   _index = 0;
+        };
+
+        inline value document::root() const
+        {
+            return _tokens.empty() ? value() : value(this, 0);
+        }
+
+    }
+}
+
+#endif
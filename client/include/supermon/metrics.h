@@ -0,0 +1,224 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_metrics_h
+#define supermon_metrics_h
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "supermon/dataset.h"
+
+namespace supermon
+{
+    namespace metrics
+    {
+
+        // updates go to one of a fixed number of shards picked by the calling thread, so threads rarely
+        // share a cache line. every update is a single relaxed atomic add, nothing waits for anything
+        constexpr std::size_t shards = 8;
+        constexpr std::size_t cacheline = 64;
+
+        // round robin shard of the calling thread
+        inline std::size_t shard()
+        {
+            static std::atomic<std::size_t> next = {0};
+            thread_local const std::size_t slot = next.fetch_add(1, std::memory_order_relaxed) % shards;
+            return slot;
+        }
+
+        struct alignas(cacheline) cell
+        {
+            std::atomic<std::uint64_t> value = {0};
+        };
+
+        class counter
+        {
+        public:
+            void add(std::uint64_t n = 1)
+            {
+                _cells[shard()].value.fetch_add(n, std::memory_order_relaxed);
+            }
+
+            counter& operator++()
+            {
+                add();
+                return *this;
+            }
+
+            counter& operator+=(std::uint64_t n)
+            {
+                add(n);
+                return *this;
+            }
+
+            std::uint64_t value() const
+            {
+                std::uint64_t total = 0;
+                for (const auto& c : _cells)
+                {
+                    total += c.value.load(std::memory_order_relaxed);
+                }
+                return total;
+            }
+
+        private:
+            cell _cells[shards];
+        };
+
+        // last value set wins, no sharding needed
+        class gauge
+        {
+        public:
+            void set(double value)
+            {
+                _value.store(value, std::memory_order_relaxed);
+            }
+
+            gauge& operator=(double value)
+            {
+                set(value);
+                return *this;
+            }
+
+            double value() const
+            {
+                return _value.load(std::memory_order_relaxed);
+            }
+
+        private:
+            alignas(cacheline) std::atomic<double> _value = {0.0};
+        };
+
+        // log-linear buckets like HdrHistogram: every power of two is split into 2^precision buckets,
+        // so a recorded value is off by less than 1/2^precision (about 6%). the unit is up to the caller
+        class histogram
+        {
+        public:
+            static constexpr unsigned precision = 4;
+            static constexpr std::size_t sub_buckets = std::size_t(1) << precision;
+            static constexpr std::size_t buckets = (65 - precision) * sub_buckets;
+
+            histogram() : _buckets(new std::atomic<std::uint64_t>[shards * buckets])
+            {
+                for (std::size_t n = 0; n < shards * buckets; ++n)
+                {
+                    _buckets[n].store(0, std::memory_order_relaxed);
+                }
+            }
+
+        public:
+            void record(std::uint64_t value)
+            {
+                const std::size_t s = shard();
+                _buckets[s * buckets + bucket(value)].fetch_add(1, std::memory_order_relaxed);
+                _sums[s].value.fetch_add(value, std::memory_order_relaxed);
+            }
+
+            template<typename Rep, typename Period>
+            void record(std::chrono::duration<Rep, Period> duration)
+            {
+                record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count()));
+            }
+
+            // bucket counts summed over the shards, cumulative since the histogram was created
+            void merge(std::uint64_t* counts, std::uint64_t& sum) const
+            {
+                for (std::size_t b = 0; b < buckets; ++b)
+                {
+                    counts[b] = 0;
+                }
+                sum = 0;
+                for (std::size_t s = 0; s < shards; ++s)
+                {
+                    const std::atomic<std::uint64_t>* shard = &_buckets[s * buckets];
+                    for (std::size_t b = 0; b < buckets; ++b)
+                    {
+                        counts[b] += shard[b].load(std::memory_order_relaxed);
+                    }
+                    sum += _sums[s].value.load(std::memory_order_relaxed);
+                }
+            }
+
+            static std::size_t bucket(std::uint64_t value)
+            {
+                if (value < sub_buckets) return static_cast<std::size_t>(value);
+                const unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(value));
+                const unsigned shift = exponent - precision;
+                return (shift + 1) * sub_buckets + static_cast<std::size_t>((value >> shift) & (sub_buckets - 1));
+            }
+
+            // largest value that falls into the bucket
+            static std::uint64_t highest(std::size_t bucket)
+            {
+                if (bucket < sub_buckets) return bucket;
+                const unsigned shift = static_cast<unsigned>(bucket / sub_buckets) - 1;
+                const std::uint64_t lowest = (sub_buckets + bucket % sub_buckets) << shift;
+                return lowest + ((std::uint64_t(1) << shift) - 1);
+            }
+
+        private:
+            std::unique_ptr<std::atomic<std::uint64_t>[]> _buckets; // shards * buckets
+            cell                                          _sums[shards];
+        };
+
+        // owns the metrics, references handed out stay valid for the registry's lifetime.
+        // registering allocates, updating and collecting don't
+        class registry
+        {
+        public:
+            // the same name always yields the same metric
+            metrics::counter& counter(const std::string& name);
+            metrics::gauge& gauge(const std::string& name);
+            metrics::histogram& histogram(const std::string& name);
+
+            // one row per metric with the rates and percentiles since the previous call
+            void collect(dataset& data, std::chrono::steady_clock::duration elapsed);
+
+            // column titles of the collected rows
+            static void header(dataset::row& header);
+
+        private:
+            enum class kind { counter, gauge, histogram };
+
+            struct entry
+            {
+                std::string                         name;
+                kind                                type;
+                std::unique_ptr<metrics::counter>   counter;
+                std::unique_ptr<metrics::gauge>     gauge;
+                std::unique_ptr<metrics::histogram> histogram;
+                std::vector<std::uint64_t>          previous; // bucket counts at the last collect
+                std::uint64_t                       last = 0; // counter value or histogram sum at the last collect
+            };
+
+            entry& find(const std::string& name, kind type);
+
+        private:
+            std::mutex                          _lock;
+            std::vector<std::unique_ptr<entry>> _entries;
+            std::vector<std::uint64_t>          _counts; // scratch for merging histogram shards
+        };
+
+    }
+}
+
+#endif
@@ -0,0 +1,392 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_msgpack_h
+#define supermon_msgpack_h
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+namespace supermon
+{
+    namespace msgpack
+    {
+
+        // JSON messages are objects, MessagePack ones start with a map header which has the high bit set
+        inline bool packed(const char* data, std::size_t size)
+        {
+            return 0 < size && 0x80 <= static_cast<unsigned char>(data[0]);
+        }
+
+        inline bool packed(const std::string& frame)
+        {
+            return packed(frame.data(), frame.size());
+        }
+
+        // MessagePack counterpart of json::writer with the same interface, so that a message can be
+        // written by the same code in either encoding. containers opened without a count get a
+        // placeholder header which is patched, and shrunk if possible, when they are closed
+        class writer
+        {
+        public:
+            explicit writer(std::string& buffer) : _buffer(buffer)
+            {
+            }
+
+        public:
+            writer& begin_object()
+            {
+                return open(0xdf);
+            }
+
+            writer& begin_object(std::size_t count)
+            {
+                return open(0x80, 0xde, 0xdf, count);
+            }
+
+            writer& end_object()
+            {
+                return close();
+            }
+
+            writer& begin_array()
+            {
+                return open(0xdd);
+            }
+
+            writer& begin_array(std::size_t count)
+            {
+                return open(0x90, 0xdc, 0xdd, count);
+            }
+
+            writer& end_array()
+            {
+                return close();
+            }
+
+            writer& key(std::string_view name)
+            {
+                element();
+                string(name);
+                _key = true;
+                return *this;
+            }
+
+            writer& value(std::string_view text)
+            {
+                element();
+                string(text);
+                return *this;
+            }
+
+            writer& value(const char* text)
+            {
+                return nullptr != text ? value(std::string_view(text)) : value(nullptr);
+            }
+
+            writer& value(const std::string& text)
+            {
+                return value(std::string_view(text));
+            }
+
+            writer& value(bool flag)
+            {
+                element();
+                _buffer += static_cast<char>(flag ? 0xc3 : 0xc2);
+                return *this;
+            }
+
+            writer& value(std::nullptr_t)
+            {
+                element();
+                _buffer += static_cast<char>(0xc0);
+                return *this;
+            }
+
+            writer& value(long long number)
+            {
+                element();
+                if (0 <= number)
+                {
+                    unsigned_integer(static_cast<unsigned long long>(number));
+                }
+                else if (-32 <= number)
+                {
+                    _buffer += static_cast<char>(number); // negative fixint
+                }
+                else if (-128 <= number)
+                {
+                    _buffer += static_cast<char>(0xd0);
+                    big_endian(static_cast<std::uint8_t>(number));
+                }
+                else if (-32768 <= number)
+                {
+                    _buffer += static_cast<char>(0xd1);
+                    big_endian(static_cast<std::uint16_t>(number));
+                }
+                else if (-2147483648LL <= number)
+                {
+                    _buffer += static_cast<char>(0xd2);
+                    big_endian(static_cast<std::uint32_t>(number));
+                }
+                else
+                {
+                    _buffer += static_cast<char>(0xd3);
+                    big_endian(static_cast<std::uint64_t>(number));
+                }
+                return *this;
+            }
+
+            writer& value(unsigned long long number)
+            {
+                element();
+                unsigned_integer(number);
+                return *this;
+            }
+
+            writer& value(int number)                { return value(static_cast<long long>(number)); }
+            writer& value(long number)               { return value(static_cast<long long>(number)); }
+            writer& value(unsigned int number)       { return value(static_cast<unsigned long long>(number)); }
+            writer& value(unsigned long number)      { return value(static_cast<unsigned long long>(number)); }
+
+            writer& value(double number)
+            {
+                element();
+                std::uint64_t bits;
+                std::memcpy(&bits, &number, sizeof(bits));
+                _buffer += static_cast<char>(0xcb);
+                big_endian(bits);
+                return *this;
+            }
+
+            writer& value(float number)
+            {
+                element();
+                std::uint32_t bits;
+                std::memcpy(&bits, &number, sizeof(bits));
+                _buffer += static_cast<char>(0xca);
+                big_endian(bits);
+                return *this;
+            }
+
+            // JSON sends these as strings for compatibility, a binary peer gets the number itself
+            writer& quoted(long long number)
+            {
+                return value(number);
+            }
+
+            // already encoded values, the caller says how many
+            writer& raw(std::string_view data, std::size_t count = 1)
+            {
+                if (0 < _depth && !_key) _counts[(_depth - 1) & 63] += static_cast<std::uint32_t>(count);
+                _key = false;
+                _buffer.append(data.data(), data.size());
+                return *this;
+            }
+
+            std::string& buffer()
+            {
+                return _buffer;
+            }
+
+        private:
+            // counts the element in the enclosing container, a key and its value count as one member
+            void element()
+            {
+                if (_key)
+                {
+                    _key = false;
+                    return;
+                }
+                if (0 < _depth) ++_counts[(_depth - 1) & 63];
+            }
+
+            writer& open(std::uint8_t fix, std::uint8_t type16, std::uint8_t type32, std::size_t count)
+            {
+                element();
+                if (count < 16)
+                {
+                    _buffer += static_cast<char>(fix | count);
+                }
+                else if (count <= 0xffff)
+                {
+                    _buffer += static_cast<char>(type16);
+                    big_endian(static_cast<std::uint16_t>(count));
+                }
+                else
+                {
+                    _buffer += static_cast<char>(type32);
+                    big_endian(static_cast<std::uint32_t>(count));
+                }
+                push(true);
+                return *this;
+            }
+
+            writer& open(std::uint8_t type32)
+            {
+                element();
+                push(false);
+                _offsets[(_depth - 1) & 63] = _buffer.size();
+                _buffer += static_cast<char>(type32);
+                big_endian(std::uint32_t(0));
+                return *this;
+            }
+
+            writer& close()
+            {
+                --_depth;
+                const std::size_t level = _depth & 63;
+                if (_counted & (std::uint64_t(1) << level)) return *this;
+
+                // patch the placeholder with the smallest header that fits
+                const std::size_t offset = _offsets[level];
+                const std::uint32_t count = _counts[level];
+                const bool map = static_cast<char>(0xdf) == _buffer[offset];
+
+                char header[5];
+                std::size_t size;
+                if (count < 16)
+                {
+                    header[0] = static_cast<char>((map ? 0x80 : 0x90) | count);
+                    size = 1;
+                }
+                else if (count <= 0xffff)
+                {
+                    header[0] = static_cast<char>(map ? 0xde : 0xdc);
+                    header[1] = static_cast<char>(count >> 8);
+                    header[2] = static_cast<char>(count);
+                    size = 3;
+                }
+                else
+                {
+                    header[0] = static_cast<char>(map ? 0xdf : 0xdd);
+                    for (int n = 0; n < 4; ++n) header[1 + n] = static_cast<char>(count >> (24 - 8 * n));
+                    size = 5;
+                }
+
+                if (size < 5)
+                {
+                    _buffer.erase(offset + size, 5 - size);
+                }
+                std::memcpy(&_buffer[offset], header, size);
+                return *this;
+            }
+
+            void push(bool counted)
+            {
+                const std::size_t level = _depth & 63;
+                _counts[level] = 0;
+                if (counted) _counted |= std::uint64_t(1) << level;
+                else _counted &= ~(std::uint64_t(1) << level);
+                ++_depth;
+            }
+
+            void unsigned_integer(unsigned long long number)
+            {
+                if (number < 128)
+                {
+                    _buffer += static_cast<char>(number); // positive fixint
+                }
+                else if (number <= 0xff)
+                {
+                    _buffer += static_cast<char>(0xcc);
+                    big_endian(static_cast<std::uint8_t>(number));
+                }
+                else if (number <= 0xffff)
+                {
+                    _buffer += static_cast<char>(0xcd);
+                    big_endian(static_cast<std::uint16_t>(number));
+                }
+                else if (number <= 0xffffffffULL)
+                {
+                    _buffer += static_cast<char>(0xce);
+                    big_endian(static_cast<std::uint32_t>(number));
+                }
+                else
+                {
+                    _buffer += static_cast<char>(0xcf);
+                    big_endian(static_cast<std::uint64_t>(number));
+                }
+            }
+
+            void string(std::string_view text)
+            {
+                const std::size_t size = text.size();
+                if (size < 32)
+                {
+                    _buffer += static_cast<char>(0xa0 | size);
+                }
+                else if (size <= 0xff)
+                {
+                    _buffer += static_cast<char>(0xd9);
+                    big_endian(static_cast<std::uint8_t>(size));
+                }
+                else if (size <= 0xffff)
+                {
+                    _buffer += static_cast<char>(0xda);
+                    big_endian(static_cast<std::uint16_t>(size));
+                }
+                else
+                {
+                    _buffer += static_cast<char>(0xdb);
+                    big_endian(static_cast<std::uint32_t>(size));
+                }
+                _buffer.append(text.data(), size);
+            }
+
+            template<typename T>
+            void big_endian(T value)
+            {
+                char bytes[sizeof(T)];
+                for (std::size_t n = 0; n < sizeof(T); ++n)
+                {
+                    bytes[n] = static_cast<char>(value >> (8 * (sizeof(T) - 1 - n)));
+                }
+                _buffer.append(bytes, sizeof(T));
+            }
+
+        private:
+            std::string&  _buffer;
+            std::size_t   _offsets[64];
+            std::uint32_t _counts[64];
+            std::uint64_t _counted = 0; // levels opened with a known count, nothing to patch
+            unsigned      _depth = 0;
+            bool          _key = false;
+        };
+
+        class error : public std::runtime_error
+        {
+        public:
+            error(const std::string& what, std::size_t offset) : std::runtime_error("msgpack: " + what + " at offset " + std::to_string(offset)), _offset(offset)
+            {
+            }
+
+            std::size_t offset() const
+            {
+                return _offset;
+            }
+
+        private:
+            std::size_t _offset;
+        };
+
+    }
+}
+
+#endif
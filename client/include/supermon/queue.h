@@ -0,0 +1,145 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_queue_h
+#define supermon_queue_h
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+namespace supermon
+{
+
+    // bounded lock-free multi-producer multi-consumer queue (D. Vyukov's algorithm)
+    // capacity is rounded up to the next power of two
+    template<typename T>
+    class queue final
+    {
+    public:
+        explicit queue(std::size_t capacity) : _capacity(round(capacity)), _mask(_capacity - 1), _cells(new cell[_capacity])
+        {
+            for (std::size_t n = 0; n < _capacity; ++n)
+            {
+                _cells[n].sequence.store(n, std::memory_order_relaxed);
+            }
+        }
+
+        queue(const queue&) = delete;
+        queue& operator=(const queue&) = delete;
+
+    public:
+        // on success the value is exchanged with the cell's previous contents, so containers
+        // travel back and forth between producers and consumers and keep their capacity
+        bool try_push(T& value)
+        {
+            cell* c = nullptr;
+            std::size_t pos = _tail.load(std::memory_order_relaxed);
+            while (true)
+            {
+                c = &_cells[pos & _mask];
+                std::size_t seq = c->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (0 == diff)
+                {
+                    if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (0 > diff)
+                {
+                    return false; // full
+                }
+                else
+                {
+                    pos = _tail.load(std::memory_order_relaxed);
+                }
+            }
+            using std::swap;
+            swap(value, c->value);
+            c->sequence.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T& value)
+        {
+            cell* c = nullptr;
+            std::size_t pos = _head.load(std::memory_order_relaxed);
+            while (true)
+            {
+                c = &_cells[pos & _mask];
+                std::size_t seq = c->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (0 == diff)
+                {
+                    if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                }
+                else if (0 > diff)
+                {
+                    return false; // empty
+                }
+                else
+                {
+                    pos = _head.load(std::memory_order_relaxed);
+                }
+            }
+            using std::swap;
+            swap(value, c->value);
+            c->sequence.store(pos + _mask + 1, std::memory_order_release);
+            return true;
+        }
+
+        // approximate, may be off by the number of operations in flight
+        std::size_t size() const
+        {
+            std::size_t tail = _tail.load(std::memory_order_relaxed);
+            std::size_t head = _head.load(std::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+
+        std::size_t capacity() const
+        {
+            return _capacity;
+        }
+
+    private:
+        static std::size_t round(std::size_t n)
+        {
+            std::size_t result = 2;
+            while (result < n) result <<= 1;
+            return result;
+        }
+
+    private:
+        struct cell
+        {
+            std::atomic<std::size_t> sequence;
+            T                        value;
+        };
+
+        static constexpr std::size_t cacheline = 64;
+
+        const std::size_t        _capacity;
+        const std::size_t        _mask;
+        std::unique_ptr<cell[]>  _cells;
+        char                     _pad0[cacheline];
+        std::atomic<std::size_t> _tail = {0};
+        char                     _pad1[cacheline - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> _head = {0};
+        char                     _pad2[cacheline - sizeof(std::atomic<std::size_t>)];
+    };
+
+}
+
+#endif
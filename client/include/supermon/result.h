@@ -0,0 +1,230 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_result_h
+#define supermon_result_h
+
+#include <string>
+#include <memory>
+#include <utility>
+#include <functional>
+
+#include "supermon/dataset.h"
+#include "supermon/executor.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <chrono>
+#include <exception>
+#include <coroutine>
+
+#include "boost/asio.hpp"
+#include "boost/asio/steady_timer.hpp"
+#endif
+
+namespace supermon
+{
+
+    // what a command handler answers, see agent::serve. it goes back to whoever sent the command
+    struct result
+    {
+        supermon::dataset data;  // a table with its header, empty answers that the command is done and nothing more
+        std::string       error; // the command failed, the data isn't sent
+
+        static result failure(std::string text)
+        {
+            result r;
+            r.error = std::move(text);
+            return r;
+        }
+    };
+
+#if defined(__cpp_impl_coroutine)
+
+    // a command handler written as a coroutine. it runs from the dispatch up to its first co_await and goes on
+    // wherever it's resumed, what it co_returns or throws is the command's result
+    class task
+    {
+    public:
+        struct promise_type
+        {
+            supermon::result                        value;
+            std::function<void (supermon::result&)> done;
+
+            task get_return_object()
+            {
+                return task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            // answers and frees the frame, nothing touches the coroutine after that
+            auto final_suspend() noexcept
+            {
+                struct finish
+                {
+                    bool await_ready() noexcept
+                    {
+                        return false;
+                    }
+
+                    void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                    {
+                        auto done = std::move(h.promise().done);
+                        auto value = std::move(h.promise().value);
+                        h.destroy();
+                        if (done) done(value);
+                    }
+
+                    void await_resume() noexcept
+                    {
+                    }
+                };
+                return finish{};
+            }
+
+            void return_value(supermon::result r)
+            {
+                value = std::move(r);
+            }
+
+            void unhandled_exception()
+            {
+                try
+                {
+                    throw;
+                }
+                catch (const std::exception& e)
+                {
+                    value = result::failure(e.what());
+                }
+                catch (...)
+                {
+                    value = result::failure("unknown exception");
+                }
+            }
+        };
+
+        task(task&& other) noexcept : _handle(std::exchange(other._handle, nullptr))
+        {
+        }
+
+        task(const task&) = delete;
+        task& operator=(const task&) = delete;
+
+        ~task()
+        {
+            if (_handle) _handle.destroy();
+        }
+
+        // runs it up to its first co_await. done gets the result on the thread that resumed it last
+        void start(std::function<void (supermon::result&)> done)
+        {
+            auto h = std::exchange(_handle, nullptr);
+            h.promise().done = std::move(done);
+            h.resume();
+        }
+
+    private:
+        explicit task(std::coroutine_handle<promise_type> h) : _handle(h)
+        {
+        }
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    // co_await post(context) goes on on the context: the agent's io_service, a strand, anything with post()
+    template<typename Context>
+    auto post(Context& context)
+    {
+        struct awaiter
+        {
+            Context& context;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                context.post([h]() { h.resume(); });
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+        return awaiter{ context };
+    }
+
+    // the same on an executor, as a command of its own without a lane limit
+    inline auto post(supermon::executor& executor)
+    {
+        struct awaiter
+        {
+            supermon::executor& executor;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                executor.submit(std::make_shared<supermon::executor::lane>(), [h]() { h.resume(); });
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+        return awaiter{ executor };
+    }
+
+    // co_await delay(io, d) goes on on the io_service once d has passed, its thread is free meanwhile. a coroutine
+    // waiting when the io_service is stopped is never resumed
+    inline auto delay(boost::asio::io_service& io, std::chrono::steady_clock::duration d)
+    {
+        struct awaiter
+        {
+            boost::asio::steady_timer timer;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                timer.async_wait([h](const boost::system::error_code&) { h.resume(); });
+            }
+
+            void await_resume() const noexcept
+            {
+            }
+        };
+        return awaiter{ boost::asio::steady_timer(io, d) };
+    }
+
+#endif
+
+}
+
+#endif
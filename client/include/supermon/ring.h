@@ -0,0 +1,89 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_ring_h
+#define supermon_ring_h
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace supermon
+{
+
+    // queue of frames in a named POSIX shared memory object, for one writing and one reading process.
+    // neither side takes a lock or makes a system call once it's mapped: the writer copies the frame in and
+    // publishes the new tail, the reader copies it out and publishes the new head. the queue outlives both,
+    // a process that maps it again finds whatever the other side hasn't read yet
+    class ring
+    {
+    public:
+        // create: make the object with room for this many bytes of frames if there is none, std::runtime_error
+        // if the one there has another size. otherwise it has to exist already, std::runtime_error if it doesn't
+        ring(const std::string& name, std::size_t capacity, bool create);
+        ~ring();
+
+        ring(const ring&) = delete;
+        ring& operator=(const ring&) = delete;
+
+    public:
+        // writer only, false if there is no room
+        bool push(std::string_view frame);
+
+        // reader only, copies the oldest frame, false if there is none
+        bool front(std::string& frame);
+
+        // reader only, drops the oldest frame
+        void pop();
+
+        bool empty() const
+        {
+            return _header->head.load(std::memory_order_acquire) == _header->tail.load(std::memory_order_acquire);
+        }
+
+        const std::string& name() const
+        {
+            return _name;
+        }
+
+    private:
+        // head and tail count bytes since the ring was made and are on lines of their own,
+        // so that the writer and the reader don't invalidate each other's cache line with every frame
+        struct header
+        {
+            std::uint64_t                           magic;
+            std::uint64_t                           capacity;
+            alignas(64) std::atomic<std::uint64_t>  head;
+            alignas(64) std::atomic<std::uint64_t>  tail;
+        };
+
+        std::uint64_t locate(std::uint64_t position, std::uint64_t& length) const;
+
+    private:
+        const std::string   _name;
+        header*             _header = nullptr;
+        char*               _data = nullptr;
+        std::size_t         _size = 0;         // of the mapping
+        std::uint64_t       _capacity = 0;     // a power of two
+        std::uint64_t       _head = 0;         // the writer's last look at the reader's position
+        std::uint64_t       _tail = 0;         // the reader's last look at the writer's position
+    };
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_series_h
+#define supermon_series_h
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+#include "supermon/dataset.h"
+
+namespace supermon
+{
+
+    // numeric samples of a few columns under one timestamp, kept at full resolution in a ring of fixed capacity
+    // and published as buckets, see agent::series. the columns are arrays of their own, so that summarizing a
+    // bucket runs over contiguous doubles. appending takes a short lock and doesn't allocate
+    class series
+    {
+    public:
+        // capacity is rounded up to a power of two
+        series(const std::vector<std::string>& columns, std::size_t capacity);
+
+        series(const series&) = delete;
+        series& operator=(const series&) = delete;
+
+    public:
+        // one value per column, in their order. the oldest sample is overwritten once the ring is full
+        template<typename... Values, typename = std::enable_if_t<std::conjunction_v<std::is_arithmetic<Values>...>>>
+        void append(std::int64_t timestamp, Values... values)
+        {
+            const double v[] = { static_cast<double>(values)... };
+            append(timestamp, v, sizeof...(Values));
+        }
+
+        // std::invalid_argument unless count is the number of columns
+        void append(std::int64_t timestamp, const double* values, std::size_t count);
+
+        // first and last timestamp, count, then min, max, mean and last of each column over the samples appended
+        // since the previous call, or what's left of them. false if there were none
+        bool bucket(dataset::row& row);
+
+        // the samples still in the ring with a timestamp in [from, to], oldest first
+        void points(dataset& data, std::int64_t from, std::int64_t to) const;
+
+        // column titles of bucket() and points()
+        void header(dataset::row& header) const;
+        void point_header(dataset::row& header) const;
+
+        const std::vector<std::string>& columns() const
+        {
+            return _columns;
+        }
+
+    private:
+        mutable std::mutex              _lock;
+        const std::vector<std::string>  _columns;
+        const std::size_t               _capacity;
+        std::vector<std::int64_t>       _times;
+        std::vector<double>             _values;        // column after column, _capacity each
+        std::uint64_t                   _appended = 0;
+        std::uint64_t                   _bucketed = 0;  // _appended at the last bucket
+    };
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_session_h
+#define supermon_session_h
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+#include "boost/asio.hpp"
+
+#include "supermon/connection.h"
+
+namespace supermon
+{
+
+    class agent;
+
+    // one websocket to a server shared by agents of the same process, each logging in with a name and instance
+    // of its own, see agent(config, session&). an agent's frames carry its "name.instance" as "@", the server and
+    // the session tell the agents apart by it. it all runs on the io_service the session is given, which has to be
+    // run by one thread. agents are constructed after the session and destroyed before it, once the io_service has
+    // stopped
+    class session final
+    {
+    public:
+        session(boost::asio::io_service& io, const supermon::endpoint& endpoint, std::chrono::milliseconds backoff_min = std::chrono::milliseconds(500), std::chrono::milliseconds backoff_max = std::chrono::milliseconds(30000));
+
+        session(const session&) = delete;
+        session& operator=(const session&) = delete;
+
+    public:
+        boost::asio::io_service& io_service()
+        {
+            return _io;
+        }
+
+        std::size_t agents() const;
+
+    private:
+        friend class agent;
+
+        // from agent::connect, the first one opens the connection. any thread
+        void join(agent& a);
+
+        // from the agent's destructor
+        void leave(agent& a);
+
+        const std::shared_ptr<supermon::connection>& connection() const
+        {
+            return _connection;
+        }
+
+    private:
+        // how far an agent got on the current connection
+        enum class state
+        {
+            waiting, // not logged in
+            greeted, // its login went out, it hasn't been told yet
+            open
+        };
+
+        struct member
+        {
+            supermon::agent* agent;
+            state            stage;
+        };
+
+        void greet(std::string& frame);
+        void opened();
+        void closed(const boost::system::error_code& error, bool lost);
+        void dispatch(char* data, std::size_t size);
+
+        // the members in the state, moved on to the next one. copies to call without holding the lock
+        std::vector<supermon::agent*> advance(state from, state to);
+
+    private:
+        boost::asio::io_service&                                _io;
+        std::shared_ptr<supermon::connection>                   _connection;
+        mutable std::mutex                                      _lock;
+        std::map<std::string, member, std::less<>>              _members; // by tag
+        bool                                                    _opened = false;
+        std::string                                             _frame; // a login sent on its own
+    };
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_snapshot_h
+#define supermon_snapshot_h
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+
+#include "supermon/dataset.h"
+
+namespace supermon
+{
+
+    // last published state of a keyed table. only the key and a hash of every row are kept,
+    // which is enough to tell which rows were inserted, updated or deleted since the last publish
+    class snapshot
+    {
+    public:
+        explicit snapshot(std::vector<std::size_t> key) : _key(std::move(key))
+        {
+        }
+
+    public:
+        const std::vector<std::size_t>& key() const
+        {
+            return _key;
+        }
+
+        // compares the rows with the ones of the previous call and makes them the new state.
+        // the changed rows are copied into inserted and updated, deleted gets the key values only.
+        // keys are expected to be unique within a dataset
+        void diff(const dataset& data)
+        {
+            inserted.clear();
+            updated.clear();
+            deleted.clear();
+
+            ++_generation;
+
+            for (const auto& row : data)
+            {
+                _bytes.clear();
+                for (std::size_t column : _key)
+                {
+                    encode(_bytes, row, column);
+                }
+                const std::size_t length = _bytes.size();
+                for (std::size_t column = 0; column < row.size(); ++column)
+                {
+                    encode(_bytes, row, column);
+                }
+                const std::uint64_t digest = hash(std::string_view(_bytes).substr(length));
+                _bytes.resize(length);
+
+                auto it = _rows.find(_bytes);
+                if (_rows.end() == it)
+                {
+                    _rows.emplace(_bytes, entry{digest, _generation});
+                    inserted.insertRow(row);
+                }
+                else
+                {
+                    if (it->second.hash != digest)
+                    {
+                        it->second.hash = digest;
+                        updated.insertRow(row);
+                    }
+                    it->second.generation = _generation;
+                }
+            }
+
+            for (auto it = _rows.begin(); it != _rows.end(); )
+            {
+                if (it->second.generation == _generation)
+                {
+                    ++it;
+                    continue;
+                }
+                decode(deleted.insertRow(), it->first);
+                it = _rows.erase(it);
+            }
+        }
+
+        void clear()
+        {
+            _rows.clear();
+            inserted.clear();
+            updated.clear();
+            deleted.clear();
+        }
+
+    public:
+        dataset inserted;
+        dataset updated;
+        dataset deleted;
+
+    private:
+        using cell = dataset::cell;
+
+        // type tag followed by the value, a missing column reads as null
+        static void encode(std::string& out, const dataset::row& row, std::size_t column)
+        {
+            if (column >= row.size())
+            {
+                out += static_cast<char>(cell::type::null);
+                return;
+            }
+
+            const cell& c = row.begin()[column];
+            out += static_cast<char>(c.kind);
+            switch (c.kind)
+            {
+                case cell::type::null:    break;
+                case cell::type::boolean: out += static_cast<char>(c.b); break;
+                case cell::type::int64:   out.append(reinterpret_cast<const char*>(&c.i), sizeof(c.i)); break;
+                case cell::type::uint64:  out.append(reinterpret_cast<const char*>(&c.u), sizeof(c.u)); break;
+                case cell::type::float32: out.append(reinterpret_cast<const char*>(&c.f), sizeof(c.f)); break;
+                case cell::type::float64: out.append(reinterpret_cast<const char*>(&c.d), sizeof(c.d)); break;
+                case cell::type::string:
+                    out.append(reinterpret_cast<const char*>(&c.s.length), sizeof(c.s.length));
+                    out.append(row.text(c), c.s.length);
+                    break;
+            }
+        }
+
+        static void decode(dataset::row& row, std::string_view bytes)
+        {
+            while (!bytes.empty())
+            {
+                const auto kind = static_cast<cell::type>(bytes[0]);
+                bytes.remove_prefix(1);
+                switch (kind)
+                {
+                    case cell::type::null:    row.add(nullptr); break;
+                    case cell::type::boolean: row.add(0 != bytes[0]); bytes.remove_prefix(1); break;
+                    case cell::type::int64:   row.add(read<long long>(bytes)); break;
+                    case cell::type::uint64:  row.add(read<unsigned long long>(bytes)); break;
+                    case cell::type::float32: row.add(read<float>(bytes)); break;
+                    case cell::type::float64: row.add(read<double>(bytes)); break;
+                    case cell::type::string:
+                        {
+                            const auto length = read<std::uint32_t>(bytes);
+                            row.add(bytes.substr(0, length));
+                            bytes.remove_prefix(length);
+                        }
+                        break;
+                }
+            }
+        }
+
+        template<typename T>
+        static T read(std::string_view& bytes)
+        {
+            T value;
+            std::memcpy(&value, bytes.data(), sizeof(T));
+            bytes.remove_prefix(sizeof(T));
+            return value;
+        }
+
+        // FNV-1a
+        static std::uint64_t hash(std::string_view bytes)
+        {
+            std::uint64_t h = 14695981039346656037ULL;
+            for (unsigned char c : bytes)
+            {
+                h ^= c;
+                h *= 1099511628211ULL;
+            }
+            return h;
+        }
+
+    private:
+        struct entry
+        {
+            std::uint64_t hash;
+            std::uint64_t generation; // last diff the row was seen in
+        };
+
+        std::vector<std::size_t>               _key;
+        std::unordered_map<std::string, entry> _rows;
+        std::uint64_t                          _generation = 0;
+        std::string                            _bytes;
+    };
+
+}
+
+#endif
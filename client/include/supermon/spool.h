@@ -0,0 +1,100 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_spool_h
+#define supermon_spool_h
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace supermon
+{
+
+    // append-only queue of frames in memory-mapped segment files of a directory, which outlives the process.
+    // records go straight into the mapping and reach the disk whenever the kernel writes the pages back,
+    // nothing waits for it. the read position is kept in a mapped file of its own, so a restarted process
+    // resumes where the last one left off. once there are more segments than allowed the oldest is dropped.
+    // not synchronized, the agent holds a lock around it
+    class spool
+    {
+    public:
+        // throws std::runtime_error if the directory can't be used
+        spool(const std::string& directory, std::size_t segment_bytes, std::size_t segments);
+        ~spool();
+
+        spool(const spool&) = delete;
+        spool& operator=(const spool&) = delete;
+
+    public:
+        // returns the number of frames lost to make room, the frame itself counts if it's larger than a segment
+        std::size_t append(std::string_view frame);
+
+        // copies the oldest frame, false if there is none
+        bool front(std::string& frame) const;
+
+        // drops the oldest frame and persists the new read position
+        void pop();
+
+        // schedules the dirty pages for writing without waiting
+        void flush();
+
+        bool empty() const
+        {
+            return 0 == _count;
+        }
+
+        std::size_t size() const
+        {
+            return _count;
+        }
+
+    private:
+        struct segment
+        {
+            std::uint64_t sequence;
+            char*         data;
+            std::size_t   size;
+        };
+
+        // where the reader is, the only thing besides the segments that has to survive a restart
+        struct position
+        {
+            std::uint64_t sequence;
+            std::uint64_t offset;
+        };
+
+        segment open(std::uint64_t sequence, bool create);
+        void close(segment& s);
+        std::string path(std::uint64_t sequence) const;
+        std::size_t record(const segment& s, std::size_t offset) const;
+        std::size_t drop();
+
+    private:
+        const std::string   _directory;
+        const std::size_t   _segment_bytes;
+        const std::size_t   _max_segments;
+        std::deque<segment> _segments;   // oldest first, the reader is in the first and the writer in the last
+        position*           _head = nullptr;
+        std::size_t         _tail = 0;   // write offset in the last segment
+        std::size_t         _count = 0;  // unread frames
+    };
+
+}
+
+#endif
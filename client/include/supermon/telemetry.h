@@ -0,0 +1,94 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_telemetry_h
+#define supermon_telemetry_h
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+#include <dirent.h>
+#include <time.h>
+
+#include "supermon/dataset.h"
+
+namespace supermon
+{
+
+    // the process's cpu, memory, faults, context switches, i/o and open files, and the cpu of each of its threads,
+    // from getrusage, the threads' cpu clocks and /proc/self. the files stay open and are read again from the start
+    // into a buffer of the collector's own, so a collect allocates nothing once the dataset has grown to its size
+    // and the threads have been seen before. a thread goes by the name it had then. linux only, elsewhere there is
+    // nothing to collect
+    class telemetry
+    {
+    public:
+        // up to threads threads are followed, those started later aren't
+        explicit telemetry(std::size_t threads = 256);
+        ~telemetry();
+
+        telemetry(const telemetry&) = delete;
+        telemetry& operator=(const telemetry&) = delete;
+
+    public:
+        // /proc/self/statm could be opened
+        bool available() const
+        {
+            return 0 <= _statm;
+        }
+
+        // one row per reading, with its rate since the previous call. false if there was nothing to read
+        bool collect(dataset& data, std::chrono::steady_clock::duration elapsed);
+
+        // column titles of the collected rows
+        static void header(dataset::row& header);
+
+    private:
+        // counters of the process, each also reported as a rate
+        enum counter { user, system, minor_faults, major_faults, voluntary, involuntary, read_bytes, written_bytes, read_calls, write_calls, counters };
+
+        struct thread
+        {
+            long                  tid;
+            clockid_t             clock;
+            std::uint64_t         cpu;   // nanoseconds
+            std::uint64_t         last;  // at the last collect
+            bool                  fresh; // not collected before, no rate yet
+            bool                  seen;  // listed by this collect
+            std::array<char, 48>  name;  // of its row, nul terminated
+        };
+
+        std::size_t read(int fd);
+        std::size_t threads();
+
+    private:
+        int                                     _statm = -1;
+        int                                     _io = -1; // not there without the permission to read it
+        DIR*                                    _fds = nullptr;
+        DIR*                                    _tasks = nullptr;
+        std::uint64_t                           _page = 4096;
+        std::uint64_t                           _last[counters] = {};
+        bool                                    _first = true; // no rates before there is something to compare
+        std::vector<thread>                     _threads; // reserved, never grows past its capacity
+        std::array<char, 4096>                  _buffer;
+    };
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#ifndef supermon_typed_dataset_h
+#define supermon_typed_dataset_h
+
+#include <tuple>
+#include <vector>
+#include <string>
+#include <utility>
+#include <optional>
+#include <cstddef>
+#include <type_traits>
+#include <string_view>
+
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
+
+// a column of a typed_dataset, its title and the type of its values:
+//
+//   SUPERMON_COLUMN(city, std::string, "City");
+//   SUPERMON_COLUMN(temperature, double, "Temperature");
+//   SUPERMON_COLUMN(wind, std::optional<double>, "Wind");
+//
+//   supermon::typed_dataset<city, temperature, wind> weather;
+//   weather.insert("London", 12.5, std::nullopt);
+#define SUPERMON_COLUMN(id, T, title) \
+    struct id \
+    { \
+        using type = T; \
+        static constexpr const char* name = title; \
+    }
+
+namespace supermon
+{
+
+    // what the agent needs of a typed_dataset without knowing its columns, one virtual call per push
+    class rowset
+    {
+    public:
+        virtual ~rowset() = default;
+
+        virtual std::size_t size() const = 0;
+
+        // the rows as an array
+        virtual void write(json::writer& w) const = 0;
+        virtual void write(msgpack::writer& w) const = 0;
+
+        // the rows one after another without the array, for merging batched pushes
+        virtual void rows(json::writer& w) const = 0;
+        virtual void rows(msgpack::writer& w) const = 0;
+
+        // only rows [from, to), for streaming them a few at a time, see agent::stream
+        virtual void rows(json::writer& w, std::size_t from, std::size_t to) const = 0;
+        virtual void rows(msgpack::writer& w, std::size_t from, std::size_t to) const = 0;
+    };
+
+    namespace column
+    {
+
+        // how the values of a C++ type are called in a schema, see agent::schema
+        template<typename T, typename = void>
+        struct traits;
+
+        template<>
+        struct traits<bool>
+        {
+            static constexpr const char* name = "boolean";
+        };
+
+        template<typename T>
+        struct traits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+        {
+            static constexpr const char* name = "integer";
+        };
+
+        template<typename T>
+        struct traits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+        {
+            static constexpr const char* name = "number";
+        };
+
+        template<>
+        struct traits<std::string>
+        {
+            static constexpr const char* name = "string";
+        };
+
+        template<>
+        struct traits<std::string_view>
+        {
+            static constexpr const char* name = "string";
+        };
+
+        template<>
+        struct traits<const char*>
+        {
+            static constexpr const char* name = "string";
+        };
+
+        // may be null
+        template<typename T>
+        struct traits<std::optional<T>>
+        {
+            static constexpr const char* name = traits<T>::name;
+        };
+
+        // picked by the type of the column at compile time, each becomes a single call of the writer
+        template<typename Writer, typename T>
+        void write(Writer& w, const T& value)
+        {
+            if constexpr (std::is_same<T, bool>::value || std::is_floating_point<T>::value)
+            {
+                w.value(value);
+            }
+            else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value)
+            {
+                w.value(static_cast<long long>(value));
+            }
+            else if constexpr (std::is_integral<T>::value)
+            {
+                w.value(static_cast<unsigned long long>(value));
+            }
+            else
+            {
+                w.value(std::string_view(value));
+            }
+        }
+
+        template<typename Writer, typename T>
+        void write(Writer& w, const std::optional<T>& value)
+        {
+            if (value) write(w, *value);
+            else w.value(nullptr);
+        }
+
+    }
+
+    // rows of values of the columns' types, in a vector of tuples. nothing is looked up or converted at run time:
+    // a row is checked by the compiler as it's inserted and written cell by cell without looking at any types.
+    // the titles don't travel with the rows, the agent declares them once per connection, see agent::schema
+    template<typename... Columns>
+    class typed_dataset final : public rowset
+    {
+    public:
+        static_assert(0 < sizeof...(Columns), "typed_dataset needs columns");
+
+        using row = std::tuple<typename Columns::type...>;
+
+        static constexpr std::size_t width = sizeof...(Columns);
+
+    public:
+        void insert(typename Columns::type... values)
+        {
+            _rows.emplace_back(std::move(values)...);
+        }
+
+        std::size_t size() const override
+        {
+            return _rows.size();
+        }
+
+        bool empty() const
+        {
+            return _rows.empty();
+        }
+
+        // keeps the allocated rows, see dataset::clear
+        void clear()
+        {
+            _rows.clear();
+        }
+
+        void reserve(std::size_t rows)
+        {
+            _rows.reserve(rows);
+        }
+
+        typename std::vector<row>::const_iterator begin() const
+        {
+            return _rows.begin();
+        }
+
+        typename std::vector<row>::const_iterator end() const
+        {
+            return _rows.end();
+        }
+
+    public:
+        void write(json::writer& w) const override
+        {
+            write_array(w);
+        }
+
+        void write(msgpack::writer& w) const override
+        {
+            write_array(w);
+        }
+
+        void rows(json::writer& w) const override
+        {
+            write_rows(w);
+        }
+
+        void rows(msgpack::writer& w) const override
+        {
+            write_rows(w);
+        }
+
+        void rows(json::writer& w, std::size_t from, std::size_t to) const override
+        {
+            write_rows(w, from, to);
+        }
+
+        void rows(msgpack::writer& w, std::size_t from, std::size_t to) const override
+        {
+            write_rows(w, from, to);
+        }
+
+        // {"columns":[...],"types":[...]} in json, made the first time it's asked for
+        static const std::string& schema()
+        {
+            static const std::string text = []()
+            {
+                std::string buffer;
+                json::writer w(buffer);
+                w.begin_object(2).key("columns").begin_array(width);
+                (w.value(Columns::name), ...);
+                w.end_array().key("types").begin_array(width);
+                (w.value(column::traits<typename Columns::type>::name), ...);
+                w.end_array().end_object();
+                return buffer;
+            }();
+            return text;
+        }
+
+    private:
+        template<typename Writer>
+        void write_array(Writer& w) const
+        {
+            w.begin_array(_rows.size());
+            write_rows(w);
+            w.end_array();
+        }
+
+        template<typename Writer>
+        void write_rows(Writer& w) const
+        {
+            for (const auto& r : _rows)
+            {
+                write_row(w, r, std::index_sequence_for<Columns...>());
+            }
+        }
+
+        template<typename Writer>
+        void write_rows(Writer& w, std::size_t from, std::size_t to) const
+        {
+            for (std::size_t n = from; n < to; ++n)
+            {
+                write_row(w, _rows[n], std::index_sequence_for<Columns...>());
+            }
+        }
+
+        template<typename Writer, std::size_t... I>
+        static void write_row(Writer& w, const row& r, std::index_sequence<I...>)
+        {
+            w.begin_array(width);
+            (column::write(w, std::get<I>(r)), ...);
+            w.end_array();
+        }
+
+    private:
+        std::vector<row> _rows;
+    };
+
+}
+
+#endif
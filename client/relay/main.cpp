@@ -0,0 +1,195 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+// keeps the server connection of an agent configured with transport::ring: takes its frames out of
+// shared memory, sends them on and puts the server's commands into the ring going back
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "boost/asio.hpp"
+#include "boost/program_options.hpp"
+
+#include "supermon/connection.h"
+#include "supermon/ring.h"
+
+// the agent may start after the relay
+static std::unique_ptr<supermon::ring> attach(const std::string& name)
+{
+    for (bool waiting = false; ; waiting = true)
+    {
+        try
+        {
+            return std::unique_ptr<supermon::ring>(new supermon::ring(name, 0, false));
+        }
+        catch (const std::exception& e)
+        {
+            if (!waiting) std::cout << "waiting for the agent: " << e.what() << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        namespace config = boost::program_options;
+        config::options_description options("options");
+        options.add_options()
+            ("help,?",                                                              ": print this message")
+            ("ring,r",    config::value<std::string>(),                             ": the agent's config::ring")
+            ("host,h",    config::value<std::string>()->default_value("localhost"), ": supermon server host")
+            ("port,p",    config::value<std::uint16_t>()->default_value(8080),      ": supermon server port")
+            ("poll,l",    config::value<long>()->default_value(50),                 ": sleep 'arg' microseconds when there is nothing to send, 0 spins");
+
+        config::variables_map arguments;
+        config::store(config::parse_command_line(argc, argv, options), arguments);
+        config::notify(arguments);
+
+        if (arguments.count("help") || !arguments.count("ring"))
+        {
+            std::cout << options << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::string name = arguments["ring"].as<std::string>();
+        const auto poll = std::chrono::microseconds(arguments["poll"].as<long>());
+
+        auto outbound = attach(name + ".out");
+        auto inbound = attach(name + ".in");
+
+        boost::asio::io_service io;
+        boost::asio::io_service::work work(io);
+
+        supermon::connection server(io, { arguments["host"].as<std::string>(), arguments["port"].as<std::uint16_t>() }, std::chrono::milliseconds(500), std::chrono::milliseconds(30000));
+
+        // the agent's login, its first frame. a restarted agent sends another one, which is passed on
+        std::mutex login_lock;
+        std::string login;
+
+        server.greet = [&](std::string& frame)
+        {
+            std::lock_guard<std::mutex> _(login_lock);
+            frame = login;
+        };
+
+        server.onopen = [&](supermon::connection&)
+        {
+            std::cout << "connected to " << server.endpoint().host << ":" << server.endpoint().port << std::endl;
+            // tells the agent about the new session, the server's answer to the login follows if it has one
+            inbound->push("{\"login\":{\"head\":{},\"body\":{}}}");
+        };
+
+        server.onclose = [&](supermon::connection& c, const boost::system::error_code& error, bool lost)
+        {
+            std::cout << (lost ? "disconnected: " : "can't connect: ") << error.message() << std::endl;
+            c.retry();
+        };
+
+        std::uint64_t dropped = 0;
+        server.onframe = [&](supermon::connection&, char* data, std::size_t size)
+        {
+            if (!inbound->push(std::string_view(data, size)) && 0 == dropped++ % 1000)
+            {
+                std::cerr << "the agent isn't reading, " << dropped << " command(s) dropped" << std::endl;
+            }
+        };
+
+        std::thread thread([&io]() { io.run(); });
+        thread.detach();
+
+        // an agent that was running before asks for its login again, the frames it wrote until then
+        // are kept here and go right after it
+        inbound->push("{\"relay\":{\"head\":{},\"body\":{}}}");
+        std::deque<std::string> early;
+
+        bool started = false;
+        std::string frame;
+        for (;;)
+        {
+            if (!early.empty() && server.connected())
+            {
+                boost::system::error_code error;
+                if (server.write(early.front(), error)) early.pop_front();
+                else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            if (!outbound->front(frame))
+            {
+                if (0 < poll.count()) std::this_thread::sleep_for(poll);
+                continue;
+            }
+
+            const bool relogin = 0 == frame.compare(0, 9, "{\"login\":");
+            if (relogin)
+            {
+                {
+                    std::lock_guard<std::mutex> _(login_lock);
+                    login = frame;
+                }
+                outbound->pop();
+
+                if (!started)
+                {
+                    io.post([&server]() { server.open(); });
+                    started = true;
+                    continue;
+                }
+                if (!server.connected()) continue; // goes with the next session
+            }
+            else if (!started)
+            {
+                early.push_back(frame);
+                outbound->pop();
+                continue;
+            }
+            else if (!server.connected())
+            {
+                // the frames wait in the ring, the agent drops what doesn't fit
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            boost::system::error_code error;
+            if (server.write(frame, error))
+            {
+                if (!relogin) outbound->pop();
+            }
+            else
+            {
+                // the io thread sees the connection fail and reconnects, the frame is sent again after that
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "supermon_relay: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -21,6 +21,11 @@
 #include <memory>
 #include <future>
 #include <chrono>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <string_view>
 
 #include "boost/asio.hpp"
 #include "beast/websocket.hpp"
@@ -32,10 +37,48 @@
 #include "boost/property_tree/json_parser.hpp"
 
 #include "supermon/agent.h"
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
 
 namespace supermon
 {
-    agent::agent(const config& config) : _config(config), _timer(_io), _socket(_io), _websocket(_socket)
+    template<typename T = std::chrono::milliseconds>
+    long long timestamp()
+    {
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<T>(now).count();
+    }
+
+    // calls f with a writer for the negotiated encoding
+    template<typename F>
+    static void encode(bool binary, std::string& frame, F&& f)
+    {
+        if (binary)
+        {
+            msgpack::writer w(frame);
+            f(w);
+        }
+        else
+        {
+            json::writer w(frame);
+            f(w);
+        }
+    }
+
+    agent::agent(const config& config) : _config(config), _owned(new boost::asio::io_service()), _io(*_owned), _queue(config.queue_size), _backlog(config.offline_messages, config.offline_bytes),
+        _flush_timer(_io), _metrics_timer(_io), _status_timer(_io), _poll_timer(_io), _series_timer(_io), _telemetry_timer(_io)
+    {
+        init();
+    }
+
+    agent::agent(const config& config, boost::asio::io_service& io) : _config(config), _io(io), _queue(config.queue_size), _backlog(config.offline_messages, config.offline_bytes),
+        _flush_timer(_io), _metrics_timer(_io), _status_timer(_io), _poll_timer(_io), _series_timer(_io), _telemetry_timer(_io)
+    {
+        init();
+    }
+
+    agent::agent(const config& config, supermon::session& session) : _config(config), _io(session.io_service()), _session(&session), _queue(config.queue_size), _backlog(config.offline_messages, config.offline_bytes),
+        _flush_timer(_io), _metrics_timer(_io), _status_timer(_io), _poll_timer(_io), _series_timer(_io), _telemetry_timer(_io)
     {
         init();
     }
@@ -43,15 +86,65 @@ namespace supermon
     agent::~agent()
     {
         shutdown();
+        if (_session) _session->leave(*this);
+    }
+
+    // the executable's name without its path
+    static std::string basename(const std::string& name)
+    {
+        std::vector<std::string> words;
+        boost::algorithm::split(words, name, boost::algorithm::is_any_of("/\\"));
+        return 0 < words.size() ? words[words.size() - 1] : name;
     }
 
     void agent::init()
     {
-        if (_config.name.empty() || _config.instance.empty() || _config.host.empty() || _config.port < 80)
+        if (_config.endpoints.empty())
+        {
+            _config.endpoints.push_back({ _config.host, _config.port });
+        }
+
+        if (_config.name.empty() || _config.instance.empty())
         {
             throw std::invalid_argument("invalid config");
         }
 
+        if (_session)
+        {
+            // the connection is shared, every frame goes out whole and right away
+            if (_config.async || !_config.spool_path.empty() || transport::ring == _config.transport) throw std::invalid_argument("invalid config");
+
+            _tag = basename(_config.name) + "." + _config.instance;
+            _connections.push_back(_session->connection());
+        }
+
+        if (transport::ring == _config.transport)
+        {
+            if (_config.ring.empty()) throw std::invalid_argument("invalid config");
+
+            _outbound.reset(new supermon::ring(_config.ring + ".out", _config.ring_bytes, true));
+            _inbound.reset(new supermon::ring(_config.ring + ".in", _config.ring_bytes, true));
+        }
+
+        for (const auto& endpoint : (_outbound || _session) ? std::vector<supermon::endpoint>() : _config.endpoints)
+        {
+            if (endpoint.host.empty() || endpoint.port < 80) throw std::invalid_argument("invalid config");
+
+            _connections.emplace_back(new connection(_io, endpoint, _config.reconnect_min, _config.reconnect_max));
+            connection& c = *_connections.back();
+            c.greet = [this](std::string& frame) { greet(frame); };
+            c.onopen = [this](connection& c) { opened(c); };
+            c.onclose = [this](connection& c, const boost::system::error_code& error, bool lost) { closed(c, error, lost); };
+            c.onframe = [this](connection& c, char* data, std::size_t size) { dispatch(&c, data, size); };
+        }
+
+        if (!_config.spool_path.empty())
+        {
+            _spool.reset(new supermon::spool(_config.spool_path, _config.spool_segment_bytes, _config.spool_segments));
+            // frames left over from the last run go out after the first login
+            _spooling = !_spool->empty();
+        }
+
         onabort = [](std::exception_ptr eptr)
         {
             try
@@ -68,9 +161,54 @@ namespace supermon
             }
         };
 
+        if (0 < _config.metrics_interval.count())
+        {
+            // one row per metric, keyed by name so only the metrics that changed travel
+            supermon::metrics::registry::header(_metrics_data.header);
+            _keys[_config.metrics_channel] = {0};
+            _metrics_when = std::chrono::steady_clock::now();
+            _io.post([this]() { sample(); });
+        }
+
+        if (0 < _config.series_interval.count())
+        {
+            _io.post([this]() { aggregate(); });
+        }
+
+        if (0 < _config.process_interval.count())
+        {
+            // keyed like the metrics. the first collect is only for the rates of the next one
+            _telemetry.reset(new supermon::telemetry());
+            if (_telemetry->available())
+            {
+                supermon::telemetry::header(_telemetry_data.header);
+                _keys[_config.process_channel] = {0};
+                _telemetry->collect(_telemetry_data, std::chrono::steady_clock::duration());
+                _telemetry_when = std::chrono::steady_clock::now();
+                _io.post([this]() { probe(); });
+            }
+        }
+
+        if (!_config.series_command.empty())
+        {
+            on(_config.series_command, [this](std::string_view, const json::value& head, const json::value& body)
+            {
+                points(head, body);
+            });
+        }
+
+        if (!_owned)
+        {
+            // whoever runs the io_service catches what the handlers throw
+            _io.post([this]() { _io_thread = std::this_thread::get_id(); });
+            return;
+        }
+
         _work = std::make_shared<boost::asio::io_service::work>(_io);
         _result = std::async(std::launch::async, [this]()
         {
+            _io_thread = std::this_thread::get_id();
+
             while (true)
             {
                 try
@@ -122,90 +260,266 @@ namespace supermon
         return _io;
     }
 
-    void agent::dispatch(std::shared_ptr<boost::asio::streambuf> streambuf)
+    supermon::statistics agent::stats() const
     {
-        std::istream is(&*streambuf);
-        auto message = std::make_shared<boost::property_tree::ptree>();
-        try
+        std::lock_guard<std::mutex> _(_backlog_lock);
+        const std::size_t buffered = _spool ? _spool->size() : _backlog.size();
+        return { _queue.size(), _sent.load(), _dropped.load(), buffered, _repeated.load(), _suppressed.load() };
+    }
+
+    supermon::metrics::registry& agent::metrics()
+    {
+        return _metrics;
+    }
+
+    supermon::series& agent::series(const std::string& channel, const std::vector<std::string>& columns)
+    {
+        std::lock_guard<std::mutex> _(_series_lock);
+        for (auto& entry : _series)
         {
-            boost::property_tree::read_json(is, *message);
+            if (entry.first != channel) continue;
+            if (entry.second->columns() != columns) throw std::invalid_argument("time series '" + channel + "' is registered with other columns");
+            return *entry.second;
+        }
 
-            const auto& tag = message->begin()->first;
-            auto& root = message->begin()->second;
+        _series.emplace_back(channel, std::unique_ptr<supermon::series>(new supermon::series(columns, _config.series_points)));
+        return *_series.back().second;
+    }
 
-            // achtung! aliasing constructor
-            auto head = std::shared_ptr<boost::property_tree::ptree>(message, &root.get_child("head"));
-            auto body = std::shared_ptr<boost::property_tree::ptree>(message, &root.get_child("body"));
+    std::vector<supermon::health> agent::health() const
+    {
+        std::vector<supermon::health> result;
+        for (const auto& c : _connections)
+        {
+            result.push_back(c->health());
+        }
+        return result;
+    }
+
+    // runs on the io thread, merges the metric shards and publishes them while connected
+    void agent::sample()
+    {
+        _metrics_timer.expires_from_now(_config.metrics_interval);
+        _metrics_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error == boost::asio::error::operation_aborted) return;
+
+            const auto now = std::chrono::steady_clock::now();
+            _metrics_data.clear();
+            _metrics.collect(_metrics_data, now - _metrics_when);
+            _metrics_when = now;
 
-            const auto& it = _handlers.find(tag);
-            if (_handlers.end() != it && it->second)
+            if (0 < _metrics_data.size() && _connected)
             {
-                head->put("tag", tag);
-                const auto& handler = it->second;
-                handler(head, body);
+                send(_config.metrics_channel, "replace", _metrics_data);
             }
-            else if (onmessage)
+
+            sample();
+        });
+    }
+
+    // runs on the io thread, reads /proc/self and publishes it while connected
+    void agent::probe()
+    {
+        _telemetry_timer.expires_from_now(_config.process_interval);
+        _telemetry_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error == boost::asio::error::operation_aborted) return;
+
+            const auto now = std::chrono::steady_clock::now();
+            _telemetry_data.clear();
+            const bool collected = _telemetry->collect(_telemetry_data, now - _telemetry_when);
+            _telemetry_when = now;
+
+            if (collected && _connected)
+            {
+                send(_config.process_channel, "replace", _telemetry_data);
+            }
+
+            probe();
+        });
+    }
+
+    // a bucket of every time series with samples since the last one, appended to its channel. buckets made
+    // while offline are kept like any other frame
+    void agent::aggregate()
+    {
+        _series_timer.expires_from_now(_config.series_interval);
+        _series_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error == boost::asio::error::operation_aborted) return;
+
+            {
+                std::lock_guard<std::mutex> _(_series_lock);
+                for (auto& entry : _series)
+                {
+                    _series_data.clear();
+                    entry.second->header(_series_data.header);
+                    if (entry.second->bucket(_series_data.insertRow()))
+                    {
+                        send(entry.first, "append", _series_data);
+                    }
+                }
+            }
+
+            aggregate();
+        });
+    }
+
+    // the samples of a time series still in its ring, to the port of the command that asked only
+    void agent::points(const json::value& head, const json::value& body)
+    {
+        const std::string channel = body.get<std::string>("channel", std::string());
+
+        supermon::series* s = nullptr;
+        {
+            std::lock_guard<std::mutex> _(_series_lock);
+            for (auto& entry : _series)
             {
-                onmessage(tag, head, body);
+                if (entry.first == channel) s = entry.second.get();
             }
         }
-        catch (const std::exception& e)
+        if (nullptr == s) throw std::invalid_argument("no time series '" + channel + "'");
+
+        // the channel's own topic keeps buckets, the points go nowhere else
+        const long port = head.get<long>("port", 0);
+        if (0 == port) throw std::invalid_argument("points of '" + channel + "' without a port to send them to");
+
+        supermon::dataset data;
+        s->points(data, body.get<std::int64_t>("from", std::numeric_limits<std::int64_t>::min()), body.get<std::int64_t>("to", std::numeric_limits<std::int64_t>::max()));
+        send(channel, "replace", data, port);
+    }
+
+    // property_tree copy of a parsed value, the way read_json would have built it
+    static ptree_t to_ptree(const json::value& value)
+    {
+        ptree_t tree;
+        if (value.is_object() || value.is_array())
         {
-            if (onerror) onerror(std::runtime_error(e.what()));
+            value.for_each([&tree](std::string_view name, const json::value& child)
+            {
+                tree.push_back(std::make_pair(std::string(name), to_ptree(child)));
+            });
+        }
+        else if (value)
+        {
+            tree.data() = std::string(value.str());
         }
-        listen(streambuf);
+        return tree;
     }
 
-    void agent::retry(std::chrono::seconds interval)
+    // {"<tag>":{"head":{...},"body":{...}}}, in json or msgpack
+    static json::value parse(json::document& document, char* data, std::size_t size, std::string_view& tag)
     {
-        _timer.expires_from_now(interval);
-        _timer.async_wait([this](const boost::system::error_code& error)
+        if (msgpack::packed(data, size))
+        {
+            document.unpack(data, size);
+        }
+        else
+        {
+            document.parse(data, size);
+        }
+
+        json::value message;
+        document.root().for_each([&](std::string_view name, const json::value& value)
         {
-            if (error != boost::asio::error::operation_aborted)
+            if (!message)
             {
-                connect();
+                tag = name;
+                message = value;
             }
         });
+
+        if (!message) throw std::invalid_argument("empty message");
+        return message;
     }
 
-    void agent::listen(std::shared_ptr<boost::asio::streambuf> buffer)
+    void agent::dispatch(connection* c, char* data, std::size_t size)
     {
-        auto streambuf = nullptr != buffer ? buffer : std::make_shared<boost::asio::streambuf>();
+        const auto received = std::chrono::steady_clock::now();
+
+        try
+        {
+            // nobody else looks at the buffer until the next read, so it's parsed where it is
+            std::string_view tag;
+            const json::value message = parse(_document, data, size, tag);
 
-        _websocket.async_read
-        (
-            *streambuf,
-            [this, streambuf](const boost::system::error_code& error)
+            const json::value head = message["head"];
+            const json::value body = message["body"];
+
+            if ("login" == tag)
             {
-                if (error)
+                // the server's answer to our login, switch if it accepted the encoding we offered
+                const bool accepted = encoding::msgpack == _config.encoding && "msgpack" == body.get<std::string_view>("encoding", "json");
+                if (_session)
                 {
-                    if (ondisconnect) ondisconnect(std::runtime_error(error.message()));
-                    retry();
-                    return;
+                    // the connection is shared, the encoding is the agent's own
+                    _binary = accepted;
+                }
+                else if (nullptr != c)
+                {
+                    c->binary(accepted);
+                    negotiate();
                 }
                 else
                 {
-                    dispatch(streambuf);
-                    if (0 < streambuf->size())
+                    // the relay says so with a login of its own every time it logged in, in json, and passes the
+                    // server's answer on after it if there is one. the server knows nothing of the keyed tables again
+                    ++_sessions;
+                    _binary = accepted;
+                    if (body.get<std::string_view>("encoding", "").empty() && onconnect) onconnect();
+                }
+            }
+            else if (nullptr == c && "relay" == tag)
+            {
+                // a relay started after the agent, it needs the login to connect
+                std::string frame;
+                greet(frame);
+                transmit(frame);
+            }
+            else
+            {
+                const auto it = std::lower_bound(_handlers.begin(), _handlers.end(), tag, [](const auto& entry, std::string_view tag)
+                {
+                    return entry.first < tag;
+                });
+                const bool handled = _handlers.end() != it && it->first == tag;
+
+                if (handled && it->second.executor)
+                {
+                    // the buffer is read into again before the handler gets to run, the command takes a copy
+                    it->second.executor.submit(it->second.lane, [this, r = it->second, frame = std::string(data, size), received]() mutable
                     {
-                        streambuf->consume(streambuf->size());
-                    }
+                        run(r, frame, received);
+                    });
+                    return;
                 }
+
+                const bool traced = track(tag, head, received);
+                execute(handled ? &it->second : nullptr, tag, head, body);
+                if (traced) complete(head.get<long>("port", 0));
             }
-        );
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
     }
 
-    void agent::send(const boost::property_tree::ptree& message)
+    // a command on the executor of its handler, with a document of its own. traced from being read, the time it
+    // waited for the executor counts towards the handler's start
+    void agent::run(const route& r, std::string& frame, std::chrono::steady_clock::time_point received)
     {
         try
         {
-            boost::asio::streambuf buffer;
-            std::ostream os(&buffer);
-            boost::property_tree::write_json(os, message, false);
-            {
-                std::lock_guard<std::mutex> _(_write_lock);
-                _websocket.write(buffer.data());
-            }
+            json::document document;
+            std::string_view tag;
+            const json::value message = parse(document, &frame[0], frame.size(), tag);
+            const json::value head = message["head"];
+
+            const bool traced = track(tag, head, received);
+            execute(&r, tag, head, message["body"]);
+            if (traced) complete(head.get<long>("port", 0));
         }
         catch (const std::exception& e)
         {
@@ -213,138 +527,1447 @@ namespace supermon
         }
     }
 
-    template<typename T = std::chrono::milliseconds>
-    long long timestamp()
+    // the handler of a command, onmessage without one. a command is answered once it's done, unless the server
+    // didn't give it an id: with its result, or the error it threw. on() and onmessage may post their work and
+    // send later, returning doesn't make them done
+    void agent::execute(const route* r, std::string_view tag, const json::value& head, const json::value& body)
     {
-        auto now = std::chrono::system_clock::now().time_since_epoch();
-        return std::chrono::duration_cast<T>(now).count();
-    }
+        const std::string id = head.get<std::string>("id", std::string());
+        const long port = head.get<long>("port", 0);
 
-    void agent::send(const std::string& channel, const std::string& action, const dataset& data, long port)
-    {
+        supermon::result result;
+        bool tracked = true;
         try
         {
-            boost::asio::streambuf buffer;
-            std::ostream os(&buffer);
-            os << "{\"push\":{"
-               << "\"when\":\"" << timestamp() << "\","
-               << "\"channel\":\"" << channel << "\","
-               << "\"action\":\"" << action << "\","
-               << "\"port\":\"" << port << "\","
-               << "\"event\":{";
+#if defined(__cpp_impl_coroutine)
+            if (nullptr != r && r->coroutine)
+            {
+                auto root = std::make_shared<ptree_t>();
+                auto h = ptree_ptr_t(root, &root->put_child("head", to_ptree(head)));
+                auto b = ptree_ptr_t(root, &root->put_child("body", to_ptree(body)));
 
-            if (0 < data.header.size())
+                // f outlives the handler being replaced, the coroutine's captures are in it
+                supermon::task t = (*r->coroutine)(std::string(tag), h, b);
+                t.start([this, f = r->coroutine, id, command = std::string(tag), port](supermon::result& value)
+                {
+                    answer(id, command, port, value);
+                });
+                return;
+            }
+#endif
+            if (nullptr != r)
             {
-                os << "\"header\":" << data.header << ",";
+                tracked = r->tracked;
+                result = r->request(tag, head, body);
             }
-
-            os << "\"data\":" << data << "}}}";
-
+            else if (onmessage)
             {
-                std::lock_guard<std::mutex> _(_write_lock);
-                _websocket.write(buffer.data());
+                tracked = false;
+                auto root = std::make_shared<ptree_t>();
+                // achtung! aliasing constructor
+                auto h = ptree_ptr_t(root, &root->put_child("head", to_ptree(head)));
+                auto b = ptree_ptr_t(root, &root->put_child("body", to_ptree(body)));
+                onmessage(std::string(tag), h, b);
+            }
+            else
+            {
+                result = supermon::result::failure("no handler for '" + std::string(tag) + "'");
             }
         }
         catch (const std::exception& e)
         {
+            result = supermon::result::failure(e.what());
             if (onerror) onerror(std::runtime_error(e.what()));
         }
+
+        // an error is known to be the end of it either way
+        answer(id, std::string(tag), port, result, tracked || !result.error.empty());
     }
 
-    void agent::send(const std::string& channel, const dataset& data, long port)
+    // commands the relay passed on, looked for every config::ring_poll
+    void agent::poll()
     {
-        send(channel, "append", data, port);
+        while (_inbound->front(_inbound_frame))
+        {
+            _inbound->pop();
+            dispatch(nullptr, &_inbound_frame[0], _inbound_frame.size());
+        }
+
+        _poll_timer.expires_from_now(_config.ring_poll);
+        _poll_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error != boost::asio::error::operation_aborted) poll();
+        });
     }
 
-    void agent::send(const std::string& channel, const std::string& text, long port)
+    // frames are encoded once for all servers, msgpack only if every one of them took it
+    void agent::negotiate()
     {
-        boost::property_tree::ptree msg;
-        msg.put("push.channel", channel);
-        msg.put("push.port", port);
-        msg.put("push.when", timestamp());
-        msg.put("push.event.text", text);
-        send(msg);
+        if (_session)
+        {
+            // the server answers the login of each agent on a session, see dispatch
+            if (!_connections.front()->connected()) _binary = false;
+            return;
+        }
+
+        bool connected = false;
+        bool binary = true;
+        for (const auto& c : _connections)
+        {
+            if (!c->connected()) continue;
+            connected = true;
+            binary = binary && c->binary();
+        }
+        _binary = connected && binary;
     }
 
-    void agent::alert(const std::string& text)
+    // writes to every server that's up, false if none of them took it
+    bool agent::write(const std::string& frame, boost::system::error_code& error)
     {
-        boost::property_tree::ptree msg;
-        msg.put("status.type", "alert");
-        msg.put("status.when", timestamp());
-        msg.put("status.text", text);
-        send(msg);
+        bool delivered = false;
+        for (auto& c : _connections)
+        {
+            if (c->connected() && c->write(frame, error, _tag)) delivered = true;
+        }
+        if (delivered) ++_sent;
+        return delivered;
     }
 
-    void agent::info(const std::string& text)
+    // the asynchronous counterpart, done is called on the io thread once every write has finished
+    void agent::transfer(const std::string& frame, std::function<void (bool delivered, const boost::system::error_code&)> done)
+    {
+        std::size_t count = 0;
+        connection* single = nullptr;
+        for (auto& c : _connections)
+        {
+            if (!c->connected()) continue;
+            single = c.get();
+            ++count;
+        }
+
+        if (0 == count)
+        {
+            done(false, boost::system::error_code());
+            return;
+        }
+
+        if (1 == count)
+        {
+            single->async_write(frame, [this, done = std::move(done)](const boost::system::error_code& error)
+            {
+                if (!error) ++_sent;
+                done(!error, error);
+            });
+            return;
+        }
+
+        struct state
+        {
+            std::size_t                                                               pending;
+            bool                                                                      delivered;
+            boost::system::error_code                                                 error;
+            std::function<void (bool delivered, const boost::system::error_code&)> done;
+        };
+        auto shared = std::make_shared<state>(state{ count, false, boost::system::error_code(), std::move(done) });
+
+        for (auto& c : _connections)
+        {
+            if (!c->connected()) continue;
+            c->async_write(frame, [this, shared](const boost::system::error_code& error)
+            {
+                if (error) shared->error = error;
+                else shared->delivered = true;
+                if (0 < --shared->pending) return;
+                if (shared->delivered) ++_sent;
+                shared->done(shared->delivered, shared->error);
+            });
+        }
+    }
+
+    // keeps the frame for after the next login, false if the connection came back meanwhile and it
+    // should be written instead. force keeps it anyway, for frames that failed on a dying connection
+    bool agent::stash(message& m, bool force)
     {
-        boost::property_tree::ptree msg;
-        msg.put("status.type", "info");
-        msg.put("status.when", timestamp());
-        msg.put("status.text", text);
-        send(msg);
+        std::lock_guard<std::mutex> _(_backlog_lock);
+        if (_connected && !_spooling && !force) return false;
+
+        if (_spool)
+        {
+            try
+            {
+                _dropped += _spool->append(m.frame);
+                _spooling = true;
+            }
+            catch (const std::exception& e)
+            {
+                ++_dropped;
+                if (onerror) onerror(std::runtime_error(e.what()));
+            }
+            return true;
+        }
+
+        _dropped += _backlog.push(m);
+        return true;
     }
 
-    void agent::panic(const std::string& text)
+    bool agent::stash(std::string& frame, const supermon::origin& origin, bool force)
     {
-        boost::property_tree::ptree msg;
-        msg.put("status.type", "panic");
-        msg.put("status.when", timestamp());
-        msg.put("status.text", text);
-        send(msg);
+        thread_local message m;
+        m.assign(origin);
+        std::swap(m.frame, frame);
+        const bool kept = stash(m, force);
+        std::swap(m.frame, frame);
+        return kept;
     }
 
-    void agent::schema(const std::string& action, const ptree_t& subtree)
+    // called right after the login, sends what was kept while offline ahead of anything new.
+    // senders wait on the lock until it's through and then find the agent connected
+    void agent::replay(connection& c)
     {
-        boost::property_tree::ptree msg;
-        msg.put("schema.action", action);
-        msg.put("schema.when", timestamp());
-        msg.add_child("schema.subtree", subtree);
-        //send(msg);
+        std::lock_guard<std::mutex> _(_backlog_lock);
+        if (_spool)
+        {
+            // the spool is written in the background, senders append to it until it's empty
+            _connected = true;
+            _io.post([this]() { if (!_unspooling) unspool(); });
+            return;
+        }
+
+        boost::system::error_code error;
+        _backlog.replay([this, &c, &error](const std::string& frame)
+        {
+            if (!c.write(frame, error, _tag)) return false;
+            ++_sent;
+            return true;
+        });
+        // whatever failed stays for the next login, the read will notice the connection is gone
+        _connected = true;
     }
 
-    void agent::connect()
+    // runs on the io thread, forwards the spool one frame at a time while it has the socket to itself
+    void agent::unspool()
     {
-        boost::asio::async_connect
-        (
-            _socket,
-            boost::asio::ip::tcp::resolver(_io).resolve(boost::asio::ip::tcp::resolver::query(_config.host, std::to_string(_config.port))),
-            [this](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator /*it*/)
+        {
+            std::lock_guard<std::mutex> _(_backlog_lock);
+            if (!_connected || !_spooling)
             {
-                if (!error)
-                {
-                    _websocket.handshake(_config.host, "/api");
-
-                    std::vector<std::string> words;
-                    boost::algorithm::split(words, _config.name, boost::algorithm::is_any_of("/\\"));
-                    const std::string& name = 0 < words.size() ? words[words.size() - 1] : std::string(_config.name);
-
-                    boost::property_tree::ptree login;
-
-                    login.put("login.name",      name);
-                    login.put("login.instance",  _config.instance);
-                    login.put("login.pid",       boost::this_process::get_id());
-                    login.put("login.hostname",  boost::asio::ip::host_name());
-                    login.put("login.when",      timestamp());
-                    login.put("login.timestamp", std::chrono::duration_cast<std::chrono::milliseconds>(_when.time_since_epoch()).count());
-
-                    send(login);
-                    
-                    if (onconnect) onconnect();
-                    
-                    listen();
-                }
-                else
-                {
-                    if (ondisconnect) ondisconnect(std::runtime_error(error.message()));
-                    retry();
-                }
+                _unspooling = false;
+                return;
+            }
+            if (!_spool->front(_spooled))
+            {
+                _spooling = false;
+                _spool->flush();
+            }
+        }
+
+        if (!_spooling)
+        {
+            _unspooling = false;
+            // anything queued meanwhile went to the spool, the queue takes over from here
+            if (_config.async && !_draining.exchange(true)) drain();
+            return;
+        }
+
+        // another server's login doesn't start a second round
+        _unspooling = true;
+
+        transfer(_spooled, [this](bool delivered, const boost::system::error_code& error)
+        {
+            if (!delivered)
+            {
+                // stays spooled for the next login
+                _unspooling = false;
+                if (error && onerror) onerror(std::runtime_error(error.message()));
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> _(_backlog_lock);
+                _spool->pop();
             }
-        );
+            unspool();
+        });
+    }
+
+    // per thread scratch buffer, traded with the send queue's cells so that it keeps its capacity
+    static std::string& scratch()
+    {
+        thread_local std::string buffer;
+        buffer.clear();
+        return buffer;
     }
 
-    void agent::on(const std::string& tag, const callback::handler& f)
+    void agent::enqueue(std::string& frame, const supermon::origin& origin)
     {
-        _handlers[tag] = f;
+        // the cell's previous frame comes back in m, its buffer goes on as the caller's scratch
+        thread_local message m;
+        m.assign(origin);
+        std::swap(m.frame, frame);
+        const bool queued = enqueue(m);
+        std::swap(m.frame, frame);
+
+        if (queued && !_draining.exchange(true))
+        {
+            _io.post([this]() { drain(); });
+        }
+    }
+
+    bool agent::enqueue(message& m)
+    {
+        while (!_queue.try_push(m))
+        {
+            switch (_config.overflow)
+            {
+                case overflow::block:
+                    // the io thread can't make room while it's blocked here, so drop instead
+                    if (std::this_thread::get_id() == _io_thread)
+                    {
+                        ++_dropped;
+                        return false;
+                    }
+                    std::this_thread::yield();
+                    break;
+
+                case overflow::drop_newest:
+                    ++_dropped;
+                    return false;
+
+                case overflow::drop_oldest:
+                    {
+                        message oldest;
+                        if (_queue.try_pop(oldest)) ++_dropped;
+                    }
+                    break;
+            }
+        }
+        return true;
+    }
+
+    // runs on the io thread, keeps at most one async_write in flight
+    void agent::drain()
+    {
+        while (true)
+        {
+            // a stream is waiting for the socket, it goes next and posts drain() again when it's done
+            if (_stream_waiting)
+            {
+                handover();
+                return;
+            }
+
+            while (!_queue.try_pop(_outgoing))
+            {
+                handover();
+                // a producer may have pushed between the failed pop and the store above
+                if (0 == _queue.size() || _draining.exchange(true)) return;
+            }
+
+            if (_connected && !_spooling) break;
+
+            // nowhere to write it to, keep it for the next login or behind the spool
+            stash(_outgoing, true);
+        }
+
+        transfer(_outgoing.frame, [this](bool delivered, const boost::system::error_code& error)
+        {
+            if (!delivered)
+            {
+                stash(_outgoing, true);
+                if (error && onerror) onerror(std::runtime_error(error.message()));
+            }
+            drain();
+        });
+    }
+
+    // lets go of the socket, a stream waiting in fragment() can't miss it
+    void agent::handover()
+    {
+        {
+            std::lock_guard<std::mutex> _(_handover_lock);
+            _draining = false;
+        }
+        _handover.notify_one();
+    }
+
+    // sends made while offline are kept without touching the socket, no exception on that path
+    void agent::transmit(std::string& frame, const supermon::origin& origin)
+    {
+        if (_outbound)
+        {
+            // a copy into shared memory, the relay does the rest. it's the offline buffer too, nothing else is kept
+            while (_outbound_lock.test_and_set(std::memory_order_acquire));
+            const bool written = _outbound->push(frame);
+            _outbound_lock.clear(std::memory_order_release);
+
+            if (written) ++_sent;
+            else ++_dropped;
+            return;
+        }
+
+        if (_config.async)
+        {
+            enqueue(frame, origin);
+            return;
+        }
+
+        if ((!_connected || _spooling) && stash(frame, origin)) return;
+
+        boost::system::error_code error;
+        if (!write(frame, error))
+        {
+            stash(frame, origin, true);
+            if (error && onerror) onerror(std::runtime_error(error.message()));
+        }
+    }
+
+    void agent::send(const boost::property_tree::ptree& message)
+    {
+        try
+        {
+            std::ostringstream os;
+            boost::property_tree::write_json(os, message, false);
+            std::string frame = os.str();
+            transmit(frame);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    // opens {"push":{...,"event":{ and leaves the three objects for the caller to close
+    template<typename Writer>
+    static void write_head(Writer& w, const std::string& channel, const std::string& action, long port, long long when, std::size_t members)
+    {
+        w.begin_object(1).key("push").begin_object(5)
+            .key("when").quoted(when)
+            .key("channel").value(channel)
+            .key("action").value(action)
+            .key("port").quoted(port)
+            .key("event").begin_object(members);
+    }
+
+    template<typename Writer>
+    static void write_key(Writer& w, const std::vector<std::size_t>& key)
+    {
+        w.begin_array(key.size());
+        for (std::size_t column : key)
+        {
+            w.value(column);
+        }
+        w.end_array();
+    }
+
+    void agent::send(const std::string& channel, const std::string& action, const dataset& data, long port)
+    {
+        if ("replace" == action)
+        {
+            std::lock_guard<std::mutex> _(_keyed_lock);
+            const auto it = _keys.find(channel);
+            if (_keys.end() != it)
+            {
+                publish(channel, data, port, it->second);
+                return;
+            }
+        }
+
+        push(channel, action, data, &data.header, port, nullptr);
+    }
+
+    // called with _keyed_lock held, which also keeps the pushes of concurrent publishers in order
+    void agent::publish(const std::string& channel, const dataset& data, long port, const std::vector<std::size_t>& key)
+    {
+        try
+        {
+            auto it = _snapshots.find(std::make_pair(channel, port));
+            if (_snapshots.end() == it)
+            {
+                it = _snapshots.emplace(std::make_pair(channel, port), keyed{ supermon::snapshot(key), ~std::uint64_t(0) }).first;
+            }
+
+            keyed& entry = it->second;
+            entry.state.diff(data);
+
+            // a reconnect or a lost message leaves the server with an unknown state, start over from a full replace
+            const std::uint64_t epoch = _sessions + _dropped;
+            if (epoch != entry.epoch)
+            {
+                push(channel, "replace", data, &data.header, port, &key);
+                entry.epoch = epoch;
+                return;
+            }
+
+            if (0 < entry.state.deleted.size()) push(channel, "delete", entry.state.deleted, &entry.state.deleted.header, port, &key);
+            if (0 < entry.state.updated.size()) push(channel, "update", entry.state.updated, &entry.state.updated.header, port, &key);
+            if (0 < entry.state.inserted.size()) push(channel, "insert", entry.state.inserted, &entry.state.inserted.header, port, &key);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    template<typename Writer>
+    static void write_rows(Writer& w, const dataset& data)
+    {
+        for (const auto& row : data)
+        {
+            row.write(w);
+        }
+    }
+
+    template<typename Writer>
+    static void write_rows(Writer& w, const rowset& data)
+    {
+        data.rows(w);
+    }
+
+    // a dataset or a typed_dataset, the header goes along unless it's null or empty
+    template<typename Rows>
+    void agent::push(const std::string& channel, const std::string& action, const Rows& data, const dataset::row* header_row, long port, const std::vector<std::size_t>* key)
+    {
+        try
+        {
+            const bool binary = _binary;
+            const bool header = nullptr != header_row && 0 < header_row->size();
+
+            if (0 < _config.batch_window.count())
+            {
+                pending entry = { channel, action, port, timestamp(), std::string(), std::string(), std::string(), data.size(), false, binary };
+                if (nullptr != key)
+                {
+                    encode(binary, entry.key, [&](auto& w) { write_key(w, *key); });
+                }
+                if (header)
+                {
+                    encode(binary, entry.header, [&](auto& w) { header_row->write(w); });
+                }
+                encode(binary, entry.rows, [&](auto& w) { write_rows(w, data); });
+                batch(std::move(entry));
+                respond(port);
+                return;
+            }
+
+            // a replace supersedes the replace kept offline before, and on keyed channels the deltas made on top of it
+            supermon::origin origin;
+            if (nullptr != key || "replace" == action)
+            {
+                origin = { &channel, port, "replace" == action };
+            }
+
+            std::string& frame = scratch();
+            encode(binary, frame, [&](auto& w)
+            {
+                write_head(w, channel, action, port, timestamp(), 1 + header + (nullptr != key));
+
+                if (nullptr != key)
+                {
+                    w.key("key");
+                    write_key(w, *key);
+                }
+
+                if (header)
+                {
+                    w.key("header");
+                    header_row->write(w);
+                }
+
+                w.key("data");
+                data.write(w);
+                w.end_object().end_object().end_object();
+            });
+
+            transmit(frame, origin);
+            respond(port);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    template<typename Writer>
+    static void write_rows(Writer& w, const dataset& data, std::size_t from, std::size_t to)
+    {
+        for (auto it = data.begin() + from; it != data.begin() + to; ++it)
+        {
+            it->write(w);
+        }
+    }
+
+    template<typename Writer>
+    static void write_rows(Writer& w, const rowset& data, std::size_t from, std::size_t to)
+    {
+        data.rows(w, from, to);
+    }
+
+    // per thread buffer of the fragments, apart from scratch(): the trace respond() sends between frames is made in that
+    static std::string& fragments()
+    {
+        thread_local std::string buffer;
+        buffer.clear();
+        return buffer;
+    }
+
+    // every server that's up gets each fragment before the next one is made. false if the frame can't be
+    // streamed and has to be made whole instead, before anything is written
+    template<typename Rows>
+    bool agent::fragment(const std::string& channel, const std::string& action, const Rows& data, const dataset::row* header_row, long port)
+    {
+        if (_outbound || !_connected || _spooling) return false;
+
+        // with config::async the io thread writes only while draining, the stream takes its place in between
+        const bool async = _config.async;
+        if (async && std::this_thread::get_id() == _io_thread) return false;
+
+        const bool binary = _binary;
+        const bool header = nullptr != header_row && 0 < header_row->size();
+        const std::size_t bytes = std::max<std::size_t>(_config.stream_fragment_bytes, 1);
+        const std::size_t rows = (0 < _config.stream_rows) ? _config.stream_rows : std::max<std::size_t>(data.size(), 1);
+        const long long when = timestamp();
+
+        std::vector<connection*> targets;
+        std::string& buffer = fragments();
+        std::size_t from = 0;
+        do
+        {
+            const std::size_t to = std::min(data.size(), from + rows);
+            const bool first = (0 == from);
+
+            std::lock_guard<std::mutex> _(_stream_lock);
+            if (async)
+            {
+                // drain() lets go at the end of the frame it's writing
+                _stream_waiting = true;
+                std::unique_lock<std::mutex> lock(_handover_lock);
+                _handover.wait(lock, [this]() { return !_draining.exchange(true); });
+                _stream_waiting = false;
+            }
+
+            targets.clear();
+            for (auto& c : _connections)
+            {
+                if (c->connected()) targets.push_back(c.get());
+            }
+
+            // a failed server is left out of the rest of the frame, the read notices it's gone
+            bool delivered = false;
+            const auto flush = [&](bool fin)
+            {
+                delivered = false;
+                for (auto& c : targets)
+                {
+                    boost::system::error_code error;
+                    if (nullptr == c) continue;
+                    if (c->write_some(fin, buffer, binary, error, _tag)) delivered = true;
+                    else c = nullptr;
+                }
+                buffer.clear();
+            };
+
+            // what was queued meanwhile goes out before the next frame
+            const auto release = [&]()
+            {
+                if (!async) return;
+                _draining = false;
+                if (0 < _queue.size() && !_draining.exchange(true)) _io.post([this]() { drain(); });
+            };
+
+            try
+            {
+                encode(binary, buffer, [&](auto& w)
+                {
+                    write_head(w, channel, first ? action : std::string("append"), port, when, 1 + (first && header));
+
+                    if (first && header)
+                    {
+                        w.key("header");
+                        header_row->write(w);
+                    }
+
+                    w.key("data").begin_array(to - from);
+                    for (std::size_t n = from; n < to; ++n)
+                    {
+                        write_rows(w, data, n, n + 1);
+                        if (buffer.size() >= bytes) flush(false);
+                    }
+                    w.end_array().end_object().end_object().end_object();
+                });
+                flush(true);
+            }
+            catch (...)
+            {
+                // the frame is ended as it is to free the connections, the server drops it
+                flush(true);
+                release();
+                throw;
+            }
+            release();
+
+            if (!delivered)
+            {
+                // the rows that are left go nowhere either
+                ++_dropped;
+                if (onerror) onerror(std::runtime_error("stream: no server took the frame of '" + channel + "'"));
+                return true;
+            }
+            ++_sent;
+            if (first) respond(port);
+
+            from = to;
+        }
+        while (from < data.size());
+
+        return true;
+    }
+
+    void agent::stream(const std::string& channel, const std::string& action, const dataset& data, long port)
+    {
+        try
+        {
+            if (fragment(channel, action, data, &data.header, port)) return;
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+            return;
+        }
+        send(channel, action, data, port);
+    }
+
+    void agent::stream(const std::string& channel, const std::string& action, const rowset& data, long port)
+    {
+        try
+        {
+            if (fragment(channel, action, data, nullptr, port)) return;
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+            return;
+        }
+        send(channel, action, data, port);
+    }
+
+    void agent::send(const std::string& channel, const dataset& data, long port)
+    {
+        send(channel, "append", data, port);
+    }
+
+    void agent::send(const std::string& channel, const rowset& data, long port)
+    {
+        send(channel, "append", data, port);
+    }
+
+    void agent::send(const std::string& channel, const std::string& action, const rowset& data, long port)
+    {
+        push(channel, action, data, nullptr, port, nullptr);
+    }
+
+    void agent::send(const std::string& channel, const std::string& text, long port)
+    {
+        try
+        {
+            const bool binary = _binary;
+            std::string& frame = scratch();
+            encode(binary, frame, [&](auto& w)
+            {
+                w.begin_object(1).key("push").begin_object(4)
+                    .key("channel").value(channel)
+                    .key("port").quoted(port)
+                    .key("when").quoted(timestamp())
+                    .key("event").begin_object(1)
+                        .key("text").value(text)
+                    .end_object()
+                .end_object().end_object();
+            });
+
+            if (0 < _config.batch_window.count())
+            {
+                batch({ channel, std::string(), port, 0, std::string(), std::string(), frame, 1, true, binary });
+                respond(port);
+                return;
+            }
+
+            transmit(frame);
+            respond(port);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    void agent::batch(pending&& entry)
+    {
+        const auto key = std::make_pair(entry.channel, entry.port);
+        const bool mergeable = !entry.text && ("append" == entry.action || "replace" == entry.action);
+        std::size_t size = entry.header.size() + entry.rows.size();
+
+        std::unique_lock<std::mutex> lock(_batch_lock);
+        const bool idle = _batch.empty();
+        const auto it = _coalesce.find(key);
+
+        if (mergeable && _coalesce.end() != it && "replace" == entry.action)
+        {
+            // a newer snapshot supersedes whatever is pending for this channel
+            pending& target = _batch[it->second];
+            _batch_bytes -= std::min(_batch_bytes, target.header.size() + target.rows.size());
+            target = std::move(entry);
+        }
+        else if (mergeable && _coalesce.end() != it && entry.binary == _batch[it->second].binary && (entry.header.empty() || entry.header == _batch[it->second].header))
+        {
+            pending& target = _batch[it->second];
+            if (!target.rows.empty() && !entry.rows.empty() && !entry.binary) target.rows += ',';
+            target.rows += entry.rows;
+            target.count += entry.count;
+            target.when = entry.when;
+            size = entry.rows.size();
+        }
+        else
+        {
+            _batch.push_back(std::move(entry));
+            // text messages and other actions pin the channel's order, later datasets must not be merged ahead of them
+            if (mergeable) _coalesce[key] = _batch.size() - 1;
+            else _coalesce.erase(key);
+        }
+
+        _batch_bytes += size;
+        const bool full = _batch_bytes >= _config.batch_bytes;
+        lock.unlock();
+
+        if (full)
+        {
+            flush();
+        }
+        else if (idle)
+        {
+            _io.post([this]()
+            {
+                _flush_timer.expires_from_now(_config.batch_window);
+                _flush_timer.async_wait([this](const boost::system::error_code& error)
+                {
+                    if (error != boost::asio::error::operation_aborted) flush();
+                });
+            });
+        }
+    }
+
+    void agent::flush()
+    {
+        std::vector<pending> entries;
+        {
+            std::lock_guard<std::mutex> _(_batch_lock);
+            entries.swap(_batch);
+            _coalesce.clear();
+            _batch_bytes = 0;
+        }
+
+        if (entries.empty()) return;
+
+        try
+        {
+            // entries encoded before and after the server accepted msgpack can't share a frame
+            std::size_t first = 0;
+            while (first < entries.size())
+            {
+                const bool binary = entries[first].binary;
+                std::size_t last = first + 1;
+                while (last < entries.size() && binary == entries[last].binary) ++last;
+
+                std::string& frame = scratch();
+                encode(binary, frame, [&](auto& w)
+                {
+                    const bool single = 1 == last - first;
+
+                    if (!single) w.begin_object(1).key("batch").begin_array(last - first);
+
+                    for (std::size_t n = first; n < last; ++n)
+                    {
+                        const pending& entry = entries[n];
+                        if (entry.text)
+                        {
+                            w.raw(entry.rows);
+                            continue;
+                        }
+
+                        write_head(w, entry.channel, entry.action, entry.port, entry.when, 1 + !entry.header.empty() + !entry.key.empty());
+                        if (!entry.key.empty())
+                        {
+                            w.key("key").raw(entry.key);
+                        }
+                        if (!entry.header.empty())
+                        {
+                            w.key("header").raw(entry.header);
+                        }
+                        w.key("data").begin_array(entry.count);
+                        if (!entry.rows.empty())
+                        {
+                            w.raw(entry.rows, entry.count);
+                        }
+                        w.end_array();
+                        w.end_object().end_object().end_object();
+                    }
+
+                    if (!single) w.end_array().end_object();
+                });
+
+                supermon::origin origin;
+                const pending& entry = entries[first];
+                if (1 == last - first && !entry.text && (!entry.key.empty() || "replace" == entry.action))
+                {
+                    origin = { &entry.channel, entry.port, "replace" == entry.action };
+                }
+
+                transmit(frame, origin);
+                first = last;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    static const char* const status_types[] = { "info", "alert", "panic" };
+
+    // the same text within the window is only counted and goes out once as a repeat count when the window
+    // ends, anything else takes a token of its type's bucket or is dropped and counted as suppressed
+    void agent::status(std::size_t type, const std::string& text)
+    {
+        std::lock_guard<std::mutex> _(_status_lock);
+
+        limiter& limiter = _limiters[type];
+        const auto now = std::chrono::steady_clock::now();
+
+        if (0 < _config.status_window.count() && text == limiter.text && now - limiter.when < _config.status_window)
+        {
+            ++_repeated;
+            if (1 == ++limiter.repeats) summarize();
+            return;
+        }
+
+        // repeats of the previous text go first and don't count against the rate
+        if (0 < limiter.repeats)
+        {
+            report(type, limiter.text, limiter.repeats, 0);
+            limiter.repeats = 0;
+        }
+
+        if (0 < _config.status_rate)
+        {
+            if (std::chrono::steady_clock::time_point() == limiter.refill)
+            {
+                limiter.tokens = _config.status_burst;
+            }
+            else
+            {
+                const double elapsed = std::chrono::duration<double>(now - limiter.refill).count();
+                limiter.tokens = std::min(_config.status_burst, limiter.tokens + elapsed * _config.status_rate);
+            }
+            limiter.refill = now;
+
+            if (limiter.tokens < 1.0)
+            {
+                ++limiter.suppressed;
+                ++_suppressed;
+                return;
+            }
+            limiter.tokens -= 1.0;
+        }
+
+        report(type, text, 0, limiter.suppressed);
+        limiter.suppressed = 0;
+        limiter.text = text;
+        limiter.when = now;
+    }
+
+    // arms the status timer for the earliest window with repeats pending, called with _status_lock held
+    void agent::summarize()
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (const auto& limiter : _limiters)
+        {
+            if (0 < limiter.repeats) deadline = std::min(deadline, limiter.when + _config.status_window);
+        }
+        if (std::chrono::steady_clock::time_point::max() == deadline) return;
+
+        _status_timer.expires_at(deadline);
+        _status_timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error == boost::asio::error::operation_aborted) return;
+
+            std::lock_guard<std::mutex> _(_status_lock);
+
+            const auto now = std::chrono::steady_clock::now();
+            for (std::size_t type = 0; type < 3; ++type)
+            {
+                limiter& limiter = _limiters[type];
+                if (0 == limiter.repeats || now - limiter.when < _config.status_window) continue;
+
+                // further repeats count into a new window
+                report(type, limiter.text, limiter.repeats, 0);
+                limiter.repeats = 0;
+                limiter.when = now;
+            }
+
+            summarize();
+        });
+    }
+
+    void agent::report(std::size_t type, const std::string& text, std::uint64_t repeat, std::uint64_t suppressed)
+    {
+        try
+        {
+            std::string& frame = scratch();
+            encode(_binary, frame, [&](auto& w)
+            {
+                w.begin_object(1).key("status").begin_object(3 + (0 < repeat) + (0 < suppressed))
+                    .key("type").value(status_types[type])
+                    .key("when").quoted(timestamp())
+                    .key("text").value(text);
+                if (0 < repeat) w.key("repeat").value(repeat);
+                if (0 < suppressed) w.key("suppressed").value(suppressed);
+                w.end_object().end_object();
+            });
+
+            transmit(frame);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    // commands are traced as {"trace":{"id":..., "hops":{...}}} in the head. the hops are stamps of the server and
+    // whatever came before it, each on its own clock, so they only mean something to whoever made them and are sent back
+    bool agent::track(std::string_view tag, const json::value& head, std::chrono::steady_clock::time_point received)
+    {
+        const json::value t = head["trace"];
+        if (!t) return false;
+
+        trace entry;
+        entry.id = t.get<std::string>("id", std::string());
+        entry.command = std::string(tag);
+        entry.port = head.get<long>("port", 0);
+        t["hops"].for_each([&](std::string_view name, const json::value& stamp)
+        {
+            if (stamp.is_number()) entry.hops.emplace_back(std::string(name), stamp.as<double>());
+        });
+        entry.received = received;
+        entry.start = std::chrono::steady_clock::now();
+
+        // a command the handler never answered is given up on once the next one for the port comes
+        {
+            std::lock_guard<std::mutex> _(_trace_lock);
+            trace& slot = _traces[entry.port];
+            std::swap(slot, entry);
+            _tracing = _traces.size();
+        }
+        if (!entry.command.empty()) emit(entry);
+        return true;
+    }
+
+    // the handler returned, the trace goes out unless the answer is still to come
+    void agent::complete(long port)
+    {
+        trace done;
+        {
+            std::lock_guard<std::mutex> _(_trace_lock);
+            const auto it = _traces.find(port);
+            if (_traces.end() == it) return;
+
+            it->second.end = std::chrono::steady_clock::now();
+            if (0 < port && std::chrono::steady_clock::time_point() == it->second.respond) return;
+
+            done = std::move(it->second);
+            _traces.erase(it);
+            _tracing = _traces.size();
+        }
+        emit(done);
+    }
+
+    // a push to the port, the first one after a traced command is taken for its answer
+    void agent::respond(long port)
+    {
+        if (0 >= port || 0 == _tracing) return;
+
+        trace done;
+        {
+            std::lock_guard<std::mutex> _(_trace_lock);
+            const auto it = _traces.find(port);
+            if (_traces.end() == it || std::chrono::steady_clock::time_point() != it->second.respond) return;
+
+            it->second.respond = std::chrono::steady_clock::now();
+            if (std::chrono::steady_clock::time_point() == it->second.end) return; // answered from within the handler
+
+            done = std::move(it->second);
+            _traces.erase(it);
+            _tracing = _traces.size();
+        }
+        emit(done);
+    }
+
+    void agent::emit(const trace& t)
+    {
+        try
+        {
+            // microseconds since the frame was read, on the agent's monotonic clock
+            const auto since = [&](std::chrono::steady_clock::time_point when)
+            {
+                return std::chrono::duration<double, std::micro>(when - t.received).count();
+            };
+            const bool ended = std::chrono::steady_clock::time_point() != t.end;
+            const bool responded = std::chrono::steady_clock::time_point() != t.respond;
+
+            std::string& frame = scratch();
+            encode(_binary, frame, [&](auto& w)
+            {
+                w.begin_object(1).key("trace").begin_object(5)
+                    .key("id").value(t.id)
+                    .key("command").value(t.command)
+                    .key("port").quoted(t.port)
+                    .key("hops").begin_object(t.hops.size());
+                for (const auto& hop : t.hops)
+                {
+                    w.key(hop.first).value(hop.second);
+                }
+                w.end_object();
+
+                w.key("agent").begin_object(1 + ended + responded).key("start").value(since(t.start));
+                if (ended) w.key("end").value(since(t.end));
+                if (responded) w.key("respond").value(since(t.respond));
+                w.end_object().end_object().end_object();
+            });
+
+            transmit(frame);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    // {"result":{"id":...,"command":...,"port":...,"when":...}} with "error":"..." or "event":{"header":[...],"data":[...]},
+    // or "untracked":true if the handler returned without saying when it's done
+    void agent::answer(const std::string& id, const std::string& command, long port, const supermon::result& r, bool tracked)
+    {
+        if (id.empty()) return;
+
+        try
+        {
+            const bool failed = !r.error.empty();
+            const bool header = !failed && 0 < r.data.header.size();
+            const bool table = !failed && (header || 0 < r.data.size());
+
+            std::string& frame = scratch();
+            encode(_binary, frame, [&](auto& w)
+            {
+                w.begin_object(1).key("result").begin_object(4 + failed + table + !tracked)
+                    .key("id").value(id)
+                    .key("command").value(command)
+                    .key("port").quoted(port)
+                    .key("when").quoted(timestamp());
+
+                if (failed) w.key("error").value(r.error);
+                if (!tracked) w.key("untracked").value(true);
+
+                if (table)
+                {
+                    w.key("event").begin_object(1 + header);
+                    if (header)
+                    {
+                        w.key("header");
+                        r.data.header.write(w);
+                    }
+                    w.key("data");
+                    r.data.write(w);
+                    w.end_object();
+                }
+                w.end_object().end_object();
+            });
+
+            transmit(frame);
+            // what an untracked handler sends is its answer, not this
+            if (tracked) respond(port);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    void agent::alert(const std::string& text)
+    {
+        status(1, text);
+    }
+
+    void agent::info(const std::string& text)
+    {
+        status(0, text);
+    }
+
+    void agent::panic(const std::string& text)
+    {
+        status(2, text);
+    }
+
+    void agent::schema(const std::string& channel, std::string_view definition)
+    {
+        {
+            std::lock_guard<std::mutex> _(_schema_lock);
+            _schemas[channel] = std::string(definition);
+        }
+
+        // otherwise it goes with the next login
+        if (!_connected) return;
+
+        try
+        {
+            // always json, the server reads both
+            std::string frame;
+            json::writer w(frame);
+            w.begin_object().key("schema").begin_object().key(channel).raw(definition).end_object().end_object();
+            transmit(frame);
+        }
+        catch (const std::exception& e)
+        {
+            if (onerror) onerror(std::runtime_error(e.what()));
+        }
+    }
+
+    void agent::connect()
+    {
+        if (_session)
+        {
+            _session->join(*this);
+            return;
+        }
+
+        _io.post([this]()
+        {
+            if (_outbound)
+            {
+                // the relay logs in with the first frame and keeps it for every session after that
+                std::string frame;
+                greet(frame);
+                transmit(frame);
+                _connected = true;
+                poll();
+                return;
+            }
+
+            if (policy::fanout == _config.policy)
+            {
+                for (auto& c : _connections) c->open();
+            }
+            else
+            {
+                _connections[_active]->open();
+            }
+        });
+    }
+
+    void agent::greet(std::string& frame)
+    {
+        const std::string name = basename(_config.name);
+
+        // a server that (re)connects knows nothing of the keyed tables, they start over from a full replace
+        ++_sessions;
+
+        json::writer w(frame);
+        w.begin_object().key("login").begin_object()
+            .key("name").value(name)
+            .key("instance").value(_config.instance)
+            .key("pid").quoted(boost::this_process::get_id())
+            .key("hostname").value(boost::asio::ip::host_name())
+            .key("when").quoted(timestamp())
+            .key("timestamp").quoted(std::chrono::duration_cast<std::chrono::milliseconds>(_when.time_since_epoch()).count());
+        if (encoding::msgpack == _config.encoding)
+        {
+            w.key("encoding").value("msgpack");
+        }
+        {
+            std::lock_guard<std::mutex> _(_schema_lock);
+            if (!_schemas.empty())
+            {
+                w.key("schema").begin_object();
+                for (const auto& entry : _schemas)
+                {
+                    w.key(entry.first).raw(entry.second);
+                }
+                w.end_object();
+            }
+        }
+        w.end_object().end_object();
+    }
+
+    // the login went out, whatever was kept while offline goes first
+    void agent::opened(connection& c)
+    {
+        negotiate();
+
+        const bool reconnected = !_connected && std::chrono::steady_clock::time_point() != _lost;
+        const auto offline = std::chrono::steady_clock::now() - _lost;
+        const std::size_t attempts = _attempts;
+
+        replay(c);
+        _failed = 0;
+        _attempts = 0;
+        _lost = std::chrono::steady_clock::time_point();
+
+        if (_config.async && !_draining.exchange(true))
+        {
+            drain();
+        }
+
+        if (reconnected && onreconnect) onreconnect(offline, attempts);
+        if (onconnect) onconnect();
+    }
+
+    void agent::closed(connection& c, const boost::system::error_code& error, bool lost)
+    {
+        bool connected = false;
+        for (const auto& other : _connections)
+        {
+            connected = connected || other->connected();
+        }
+
+        if (lost)
+        {
+            // keyed channels start over from a full replace while offline, so the backlog keeps only the latest
+            ++_sessions;
+            if (!connected)
+            {
+                _connected = false;
+                _lost = std::chrono::steady_clock::now();
+            }
+        }
+        else
+        {
+            ++_attempts;
+        }
+        negotiate();
+
+        if (ondisconnect)
+        {
+            const auto& endpoint = c.endpoint();
+            ondisconnect(std::runtime_error(1 < _connections.size() ? endpoint.host + ":" + std::to_string(endpoint.port) + ": " + error.message() : error.message()));
+        }
+
+        // the session reconnects
+        if (_session) return;
+
+        if (policy::fanout == _config.policy)
+        {
+            c.retry();
+            return;
+        }
+
+        // straight on to the next server, backing off only once every one of them failed in a row
+        _active = (_active + 1) % _connections.size();
+        if (++_failed < _connections.size())
+        {
+            _connections[_active]->open();
+        }
+        else
+        {
+            _failed = 0;
+            _connections[_active]->retry();
+        }
+    }
+
+    void agent::key(const std::string& channel, const std::vector<std::size_t>& columns)
+    {
+        std::lock_guard<std::mutex> _(_keyed_lock);
+        _keys[channel] = columns;
+
+        // states kept under the old key would produce wrong deltas
+        for (auto it = _snapshots.begin(); it != _snapshots.end(); )
+        {
+            if (it->first.first == channel) it = _snapshots.erase(it);
+            else ++it;
+        }
+    }
+
+    void agent::on(const std::string& tag, const callback::command& f, const execution& how)
+    {
+        route r;
+        if (f)
+        {
+            r.request = [f](std::string_view tag, const json::value& head, const json::value& body)
+            {
+                f(tag, head, body);
+                return supermon::result();
+            };
+        }
+        install(tag, std::move(r), how);
+    }
+
+    void agent::serve(const std::string& tag, const callback::request& f, const execution& how)
+    {
+        route r;
+        r.request = f;
+        r.tracked = true;
+        install(tag, std::move(r), how);
+    }
+
+#if defined(__cpp_impl_coroutine)
+    void agent::serve(const std::string& tag, const callback::coroutine& f, const execution& how)
+    {
+        route r;
+        if (f) r.coroutine = std::make_shared<callback::coroutine>(f);
+        install(tag, std::move(r), how);
+    }
+#endif
+
+    // a route without a handler takes the tag's away, its commands go to onmessage again
+    void agent::install(const std::string& tag, route&& r, const execution& how)
+    {
+        r.executor = how.executor;
+        r.lane = std::make_shared<supermon::executor::lane>();
+        r.lane->concurrency = how.concurrency;
+        r.lane->priority = how.priority;
+
+        const auto it = std::lower_bound(_handlers.begin(), _handlers.end(), tag, [](const auto& entry, const std::string& tag)
+        {
+            return entry.first < tag;
+        });
+
+        bool empty = !r.request;
+#if defined(__cpp_impl_coroutine)
+        empty = empty && !r.coroutine;
+#endif
+        if (_handlers.end() != it && it->first == tag)
+        {
+            if (empty) _handlers.erase(it);
+            else it->second = std::move(r);
+        }
+        else if (!empty)
+        {
+            _handlers.emplace(it, tag, std::move(r));
+        }
+    }
+
+    void agent::on(const std::string& tag, const callback::handler& f, const execution& how)
+    {
+        if (!f)
+        {
+            on(tag, callback::command(), how);
+            return;
+        }
+
+        // compatibility adapter, copies the views into a property_tree the handler can keep
+        on(tag, callback::command([f](std::string_view tag, const json::value& head, const json::value& body)
+        {
+            auto root = std::make_shared<ptree_t>();
+            // achtung! aliasing constructor
+            auto h = ptree_ptr_t(root, &root->put_child("head", to_ptree(head)));
+            auto b = ptree_ptr_t(root, &root->put_child("body", to_ptree(body)));
+            h->put("tag", std::string(tag));
+            f(h, b);
+        }), how);
     }
 
 }
@@ -0,0 +1,324 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <array>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "supermon/connection.h"
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
+
+namespace supermon
+{
+
+    connection::connection(boost::asio::io_service& io, const supermon::endpoint& endpoint, std::chrono::milliseconds backoff_min, std::chrono::milliseconds backoff_max)
+        : _endpoint(endpoint), _backoff_min(backoff_min), _backoff_max(std::max(backoff_min, backoff_max)), _random(std::random_device()()),
+          _timer(io), _resolver(io), _socket(io)
+    {
+    }
+
+    supermon::health connection::health() const
+    {
+        return
+        {
+            _endpoint, _connected.load(), _sent.load(), _failed.load(), _logins.load(), _errors.load(), _lost.load(),
+            std::chrono::steady_clock::duration(_downtime.load())
+        };
+    }
+
+    void connection::open()
+    {
+        _timer.cancel();
+        resolve();
+    }
+
+    void connection::retry()
+    {
+        auto delay = _backoff_min;
+        for (std::size_t n = 0; n < _attempts && delay < _backoff_max; ++n)
+        {
+            delay *= 2;
+        }
+        delay = std::min(delay, _backoff_max);
+        ++_attempts;
+
+        const auto half = delay.count() / 2;
+        delay -= std::chrono::milliseconds(0 < half ? static_cast<long long>(_random() % (half + 1)) : 0);
+
+        _timer.expires_from_now(delay);
+        _timer.async_wait([this](const boost::system::error_code& error)
+        {
+            if (error != boost::asio::error::operation_aborted)
+            {
+                resolve();
+            }
+        });
+    }
+
+    void connection::resolve()
+    {
+        if (!_endpoints.empty())
+        {
+            dial();
+            return;
+        }
+
+        _resolver.async_resolve
+        (
+            boost::asio::ip::tcp::resolver::query(_endpoint.host, std::to_string(_endpoint.port)),
+            [this](const boost::system::error_code& error, boost::asio::ip::tcp::resolver::iterator it)
+            {
+                if (error)
+                {
+                    fail(error, false);
+                    return;
+                }
+
+                for (; boost::asio::ip::tcp::resolver::iterator() != it; ++it)
+                {
+                    _endpoints.push_back(it->endpoint());
+                }
+                dial();
+            }
+        );
+    }
+
+    void connection::dial()
+    {
+        boost::asio::async_connect
+        (
+            _socket,
+            _endpoints.begin(),
+            _endpoints.end(),
+            [this](const boost::system::error_code& error, std::vector<boost::asio::ip::tcp::endpoint>::iterator)
+            {
+                if (error)
+                {
+                    // the server may have moved, look it up again next time
+                    _endpoints.clear();
+                    fail(error, false);
+                    return;
+                }
+
+                handshake();
+            }
+        );
+    }
+
+    void connection::handshake()
+    {
+        {
+            std::lock_guard<std::mutex> _(_write_lock);
+            _websocket.emplace(_socket);
+        }
+
+        _websocket->async_handshake(_endpoint.host, "/api", [this](const boost::system::error_code& error)
+        {
+            if (error)
+            {
+                fail(error, false);
+                return;
+            }
+
+            login();
+        });
+    }
+
+    void connection::login()
+    {
+        // every session starts in json, the server answers the login if it takes the offered encoding
+        _binary = false;
+
+        _login.clear();
+        if (greet) greet(_login);
+
+        _websocket->binary(false);
+        _websocket->async_write(boost::asio::buffer(_login), [this](const boost::system::error_code& error)
+        {
+            if (error)
+            {
+                fail(error, false);
+                return;
+            }
+
+            _attempts = 0;
+            ++_logins;
+            if (std::chrono::steady_clock::time_point() != _down)
+            {
+                _downtime = (std::chrono::steady_clock::now() - _down).count();
+            }
+
+            _connected = true;
+            if (onopen) onopen(*this);
+
+            listen();
+        });
+    }
+
+    void connection::listen()
+    {
+        _websocket->async_read
+        (
+            _buffer,
+            [this](const boost::system::error_code& error)
+            {
+                if (error)
+                {
+                    fail(error, true);
+                    return;
+                }
+
+                // nobody else looks at the buffer until the next read, so it's handed out where it is
+                auto data = _buffer.data();
+                if (onframe) onframe(*this, const_cast<char*>(boost::asio::buffer_cast<const char*>(data)), boost::asio::buffer_size(data));
+                _buffer.consume(_buffer.size());
+
+                listen();
+            }
+        );
+    }
+
+    void connection::fail(const boost::system::error_code& error, bool lost)
+    {
+        if (lost)
+        {
+            ++_lost;
+            _down = std::chrono::steady_clock::now();
+        }
+        else
+        {
+            ++_errors;
+        }
+
+        _connected = false;
+        _buffer.consume(_buffer.size());
+
+        boost::system::error_code ignored;
+        _socket.close(ignored);
+
+        if (onclose) onclose(*this, error, lost);
+    }
+
+    // the frame keeps its members and loses its opening, which the prefix brings along with one more member
+    void connection::tagged(std::string& prefix, const std::string& frame, std::string_view tag)
+    {
+        prefix.clear();
+        if (msgpack::packed(frame))
+        {
+            prefix += static_cast<char>(frame[0] + 1);
+            msgpack::writer w(prefix);
+            w.value("@").value(tag);
+        }
+        else
+        {
+            prefix += "{\"@\":";
+            json::writer w(prefix);
+            w.value(tag);
+            prefix += ',';
+        }
+    }
+
+    bool connection::write(const std::string& frame, boost::system::error_code& error, std::string_view tag)
+    {
+        std::lock_guard<std::mutex> _(_write_lock);
+        if (!_websocket)
+        {
+            error = boost::asio::error::not_connected;
+            ++_failed;
+            return false;
+        }
+        _websocket->binary(msgpack::packed(frame));
+        if (tag.empty())
+        {
+            _websocket->write(boost::asio::buffer(frame), error);
+        }
+        else
+        {
+            tagged(_prefix, frame, tag);
+            const std::array<boost::asio::const_buffer, 2> buffers = {{ boost::asio::buffer(_prefix), boost::asio::buffer(frame.data() + 1, frame.size() - 1) }};
+            _websocket->write(buffers, error);
+        }
+        if (error)
+        {
+            ++_failed;
+            return false;
+        }
+        ++_sent;
+        return true;
+    }
+
+    bool connection::write_some(bool fin, const std::string& fragment, bool binary, boost::system::error_code& error, std::string_view tag)
+    {
+        if (!_fragmented)
+        {
+            _write_lock.lock();
+            if (!_websocket)
+            {
+                _write_lock.unlock();
+                error = boost::asio::error::not_connected;
+                ++_failed;
+                return false;
+            }
+            _fragmented = true;
+            _websocket->binary(binary);
+
+            if (!tag.empty())
+            {
+                tagged(_prefix, fragment, tag);
+                const std::array<boost::asio::const_buffer, 2> buffers = {{ boost::asio::buffer(_prefix), boost::asio::buffer(fragment.data() + 1, fragment.size() - 1) }};
+                _websocket->write_some(fin, buffers, error);
+            }
+            else
+            {
+                _websocket->write_some(fin, boost::asio::buffer(fragment), error);
+            }
+        }
+        else
+        {
+            _websocket->write_some(fin, boost::asio::buffer(fragment), error);
+        }
+        if (!error && !fin) return true;
+
+        _fragmented = false;
+        _write_lock.unlock();
+        if (error)
+        {
+            ++_failed;
+            return false;
+        }
+        ++_sent;
+        return true;
+    }
+
+    void connection::async_write(const std::string& frame, std::function<void (const boost::system::error_code&)> handler)
+    {
+        _websocket->binary(msgpack::packed(frame));
+        _websocket->async_write
+        (
+            boost::asio::buffer(frame),
+            [this, handler = std::move(handler)](const boost::system::error_code& error)
+            {
+                if (error) ++_failed;
+                else ++_sent;
+                handler(error);
+            }
+        );
+    }
+
+}
@@ -0,0 +1,96 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <mutex>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+
+#include "supermon/executor.h"
+
+namespace supermon
+{
+
+    executor::executor(post_type post)
+    {
+        if (!post) throw std::invalid_argument("executor: no post function");
+
+        _state = std::make_shared<state>();
+        _state->post = std::move(post);
+    }
+
+    // every job posts a pump, and so does every job that finishes while others wait. a pump that finds nothing
+    // it may run does nothing, the one that comes with the next free slot picks the job up
+    void executor::submit(const std::shared_ptr<lane>& l, std::function<void ()> job)
+    {
+        {
+            std::lock_guard<std::mutex> _(_state->lock);
+            _state->waiting.emplace(std::make_pair(-l->priority, _state->sequence++), executor::job{ l, std::move(job) });
+        }
+
+        auto s = _state;
+        s->post([s]() { pump(s); });
+    }
+
+    std::size_t executor::waiting() const
+    {
+        if (!_state) return 0;
+
+        std::lock_guard<std::mutex> _(_state->lock);
+        return _state->waiting.size();
+    }
+
+    void executor::pump(const std::shared_ptr<state>& s)
+    {
+        job next;
+        {
+            std::lock_guard<std::mutex> _(s->lock);
+            auto it = s->waiting.begin();
+            while (s->waiting.end() != it && 0 != it->second.handler->concurrency && it->second.handler->running >= it->second.handler->concurrency)
+            {
+                ++it;
+            }
+            if (s->waiting.end() == it) return;
+
+            next = std::move(it->second);
+            s->waiting.erase(it);
+            ++next.handler->running;
+        }
+
+        const auto finish = [&]()
+        {
+            bool more;
+            {
+                std::lock_guard<std::mutex> _(s->lock);
+                --next.handler->running;
+                more = !s->waiting.empty();
+            }
+            if (more) s->post([s]() { pump(s); });
+        };
+
+        try
+        {
+            next.run();
+        }
+        catch (...)
+        {
+            finish();
+            throw;
+        }
+        finish();
+    }
+
+}
@@ -0,0 +1,384 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <charconv>
+#include <cstring>
+
+#include "supermon/json.h"
+
+namespace supermon
+{
+    namespace json
+    {
+        namespace
+        {
+            const unsigned max_depth = 128;
+
+            int hex(char c)
+            {
+                if ('0' <= c && c <= '9') return c - '0';
+                if ('a' <= c && c <= 'f') return c - 'a' + 10;
+                if ('A' <= c && c <= 'F') return c - 'A' + 10;
+                return -1;
+            }
+
+            char* utf8(char* out, std::uint32_t cp)
+            {
+                if (cp < 0x80)
+                {
+                    *out++ = static_cast<char>(cp);
+                }
+                else if (cp < 0x800)
+                {
+                    *out++ = static_cast<char>(0xc0 | (cp >> 6));
+                    *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                else if (cp < 0x10000)
+                {
+                    *out++ = static_cast<char>(0xe0 | (cp >> 12));
+                    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                else
+                {
+                    *out++ = static_cast<char>(0xf0 | (cp >> 18));
+                    *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+                    *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                return out;
+            }
+        }
+
+        template<typename Token>
+        class parser
+        {
+        public:
+            parser(char* text, std::size_t size, std::vector<Token>& tokens) : _begin(text), _p(text), _end(text + size), _tokens(tokens)
+            {
+            }
+
+            void parse()
+            {
+                space();
+                parse_value(0);
+                space();
+                if (_p != _end) fail("unexpected trailing characters");
+            }
+
+        private:
+            [[noreturn]] void fail(const char* what)
+            {
+                throw error(what, _p - _begin);
+            }
+
+            void space()
+            {
+                while (_p != _end && (' ' == *_p || '\n' == *_p || '\r' == *_p || '\t' == *_p)) ++_p;
+            }
+
+            bool literal(const char* word, std::size_t length)
+            {
+                if (static_cast<std::size_t>(_end - _p) < length || 0 != std::memcmp(_p, word, length)) return false;
+                _p += length;
+                return true;
+            }
+
+            std::uint32_t add(document::type kind)
+            {
+                _tokens.emplace_back();
+                Token& t = _tokens.back();
+                t.kind = kind;
+                t.integral = false;
+                t.size = 0;
+                t.i = 0;
+                return static_cast<std::uint32_t>(_tokens.size() - 1);
+            }
+
+            void parse_value(unsigned depth)
+            {
+                if (_p == _end) fail("unexpected end of input");
+
+                switch (*_p)
+                {
+                    case '{': parse_object(depth); break;
+                    case '[': parse_array(depth); break;
+                    case '"':
+                        {
+                            std::uint32_t index = add(document::type::string);
+                            _tokens[index].text = parse_string();
+                            _tokens[index].next = index + 1;
+                        }
+                        break;
+                    case 't':
+                    case 'f':
+                    case 'n':
+                        {
+                            std::uint32_t index = add(document::type::boolean);
+                            if (literal("true", 4)) _tokens[index].b = true;
+                            else if (literal("false", 5)) _tokens[index].b = false;
+                            else if (literal("null", 4)) _tokens[index].kind = document::type::null;
+                            else fail("invalid literal");
+                            _tokens[index].next = index + 1;
+                        }
+                        break;
+                    default:
+                        parse_number();
+                        break;
+                }
+            }
+
+            void parse_object(unsigned depth)
+            {
+                if (max_depth < depth) fail("nesting too deep");
+
+                std::uint32_t index = add(document::type::object);
+                std::uint32_t size = 0;
+
+                ++_p;
+                space();
+                if (_p != _end && '}' == *_p)
+                {
+                    ++_p;
+                }
+                else
+                {
+                    while (true)
+                    {
+                        if (_p == _end || '"' != *_p) fail("expected a member name");
+
+                        std::uint32_t key = add(document::type::string);
+                        _tokens[key].text = parse_string();
+                        _tokens[key].next = key + 1;
+
+                        space();
+                        if (_p == _end || ':' != *_p) fail("expected ':'");
+                        ++_p;
+                        space();
+                        parse_value(depth + 1);
+                        ++size;
+                        space();
+
+                        if (_p == _end) fail("unexpected end of input");
+                        if ('}' == *_p)
+                        {
+                            ++_p;
+                            break;
+                        }
+                        if (',' != *_p) fail("expected ',' or '}'");
+                        ++_p;
+                        space();
+                    }
+                }
+
+                _tokens[index].size = size;
+                _tokens[index].next = static_cast<std::uint32_t>(_tokens.size());
+            }
+
+            void parse_array(unsigned depth)
+            {
+                if (max_depth < depth) fail("nesting too deep");
+
+                std::uint32_t index = add(document::type::array);
+                std::uint32_t size = 0;
+
+                ++_p;
+                space();
+                if (_p != _end && ']' == *_p)
+                {
+                    ++_p;
+                }
+                else
+                {
+                    while (true)
+                    {
+                        parse_value(depth + 1);
+                        ++size;
+                        space();
+
+                        if (_p == _end) fail("unexpected end of input");
+                        if (']' == *_p)
+                        {
+                            ++_p;
+                            break;
+                        }
+                        if (',' != *_p) fail("expected ',' or ']'");
+                        ++_p;
+                        space();
+                    }
+                }
+
+                _tokens[index].size = size;
+                _tokens[index].next = static_cast<std::uint32_t>(_tokens.size());
+            }
+
+            void parse_number()
+            {
+                char* start = _p;
+                bool integral = true;
+
+                if (_p != _end && '-' == *_p) ++_p;
+                while (_p != _end)
+                {
+                    const char c = *_p;
+                    if ('0' <= c && c <= '9')
+                    {
+                        ++_p;
+                    }
+                    else if ('.' == c || 'e' == c || 'E' == c || '+' == c || '-' == c)
+                    {
+                        integral = false;
+                        ++_p;
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+
+                if (start == _p) fail("unexpected character");
+
+                std::uint32_t index = add(document::type::number);
+                Token& t = _tokens[index];
+                t.text = std::string_view(start, _p - start);
+                t.next = index + 1;
+
+                if (integral)
+                {
+                    auto r = std::from_chars(start, _p, t.i);
+                    // too big for 64 bits, fall back to a double
+                    integral = std::errc() == r.ec && r.ptr == _p;
+                }
+
+                if (integral)
+                {
+                    t.integral = true;
+                }
+                else
+                {
+                    auto r = std::from_chars(start, _p, t.d);
+                    if (std::errc() != r.ec || r.ptr != _p) fail("invalid number");
+                }
+            }
+
+            // unescapes in place, the result is never longer than the escaped text
+            std::string_view parse_string()
+            {
+                ++_p;
+                char* out = _p;
+                char* start = _p;
+
+                while (true)
+                {
+                    // plain run, nothing to move until the first escape
+                    while (_p != _end && '"' != *_p && '\\' != *_p)
+                    {
+                        if (static_cast<unsigned char>(*_p) < 0x20) fail("control character in string");
+                        if (out != _p) *out = *_p;
+                        ++out;
+                        ++_p;
+                    }
+
+                    if (_p == _end) fail("unterminated string");
+
+                    if ('"' == *_p)
+                    {
+                        ++_p;
+                        return std::string_view(start, out - start);
+                    }
+
+                    ++_p; // backslash
+                    if (_p == _end) fail("unterminated string");
+
+                    switch (*_p++)
+                    {
+                        case '"':  *out++ = '"'; break;
+                        case '\\': *out++ = '\\'; break;
+                        case '/':  *out++ = '/'; break;
+                        case 'b':  *out++ = '\b'; break;
+                        case 'f':  *out++ = '\f'; break;
+                        case 'n':  *out++ = '\n'; break;
+                        case 'r':  *out++ = '\r'; break;
+                        case 't':  *out++ = '\t'; break;
+                        case 'u':
+                            {
+                                std::uint32_t cp = code_unit();
+                                if (0xd800 <= cp && cp < 0xdc00)
+                                {
+                                    // surrogate pair
+                                    if (2 <= _end - _p && '\\' == _p[0] && 'u' == _p[1])
+                                    {
+                                        _p += 2;
+                                        std::uint32_t low = code_unit();
+                                        if (0xdc00 <= low && low < 0xe000) cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                                        else cp = 0xfffd;
+                                    }
+                                    else
+                                    {
+                                        cp = 0xfffd;
+                                    }
+                                }
+                                else if (0xdc00 <= cp && cp < 0xe000)
+                                {
+                                    cp = 0xfffd;
+                                }
+                                out = utf8(out, cp);
+                            }
+                            break;
+                        default:
+                            fail("invalid escape");
+                    }
+                }
+            }
+
+            std::uint32_t code_unit()
+            {
+                if (4 > _end - _p) fail("invalid unicode escape");
+                std::uint32_t cp = 0;
+                for (int n = 0; n < 4; ++n)
+                {
+                    int digit = hex(*_p++);
+                    if (0 > digit) fail("invalid unicode escape");
+                    cp = (cp << 4) | static_cast<std::uint32_t>(digit);
+                }
+                return cp;
+            }
+
+        private:
+            char*               _begin;
+            char*               _p;
+            char*               _end;
+            std::vector<Token>& _tokens;
+        };
+
+        void document::parse(char* text, std::size_t size)
+        {
+            _tokens.clear();
+            try
+            {
+                parser<token>(text, size, _tokens).parse();
+            }
+            catch (...)
+            {
+                _tokens.clear();
+                throw;
+            }
+        }
+
+    }
+}
@@ -0,0 +1,160 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+
+#include "supermon/metrics.h"
+
+namespace supermon
+{
+    namespace metrics
+    {
+
+        registry::entry& registry::find(const std::string& name, kind type)
+        {
+            for (auto& entry : _entries)
+            {
+                if (entry->name != name) continue;
+                if (entry->type != type) throw std::invalid_argument("metric '" + name + "' is registered with another type");
+                return *entry;
+            }
+
+            _entries.emplace_back(new entry());
+            entry& result = *_entries.back();
+            result.name = name;
+            result.type = type;
+            return result;
+        }
+
+        metrics::counter& registry::counter(const std::string& name)
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            entry& e = find(name, kind::counter);
+            if (!e.counter) e.counter.reset(new metrics::counter());
+            return *e.counter;
+        }
+
+        metrics::gauge& registry::gauge(const std::string& name)
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            entry& e = find(name, kind::gauge);
+            if (!e.gauge) e.gauge.reset(new metrics::gauge());
+            return *e.gauge;
+        }
+
+        metrics::histogram& registry::histogram(const std::string& name)
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            entry& e = find(name, kind::histogram);
+            if (!e.histogram)
+            {
+                e.histogram.reset(new metrics::histogram());
+                e.previous.assign(metrics::histogram::buckets, 0);
+                _counts.resize(metrics::histogram::buckets);
+            }
+            return *e.histogram;
+        }
+
+        void registry::header(dataset::row& header)
+        {
+            header.clear();
+            header += "Metric", "Type", "Value", "Rate (/s)", "Count", "Mean", "p50", "p99", "p99.9", "Max";
+        }
+
+        // value at the given quantile of the interval's samples, the top of the bucket it falls into
+        static std::uint64_t quantile(const std::vector<std::uint64_t>& counts, std::uint64_t total, double q)
+        {
+            std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(total) + 0.5);
+            if (rank < 1) rank = 1;
+
+            std::uint64_t seen = 0;
+            for (std::size_t b = 0; b < counts.size(); ++b)
+            {
+                seen += counts[b];
+                if (seen >= rank) return metrics::histogram::highest(b);
+            }
+            return 0;
+        }
+
+        void registry::collect(dataset& data, std::chrono::steady_clock::duration elapsed)
+        {
+            std::lock_guard<std::mutex> _(_lock);
+
+            const double seconds = std::chrono::duration<double>(elapsed).count();
+
+            for (auto& entry : _entries)
+            {
+                dataset::row& r = data.insertRow();
+                r += entry->name;
+
+                switch (entry->type)
+                {
+                    case kind::counter:
+                        {
+                            const std::uint64_t value = entry->counter->value();
+                            const std::uint64_t delta = value - entry->last;
+                            entry->last = value;
+                            r += "counter", value, 0 < seconds ? delta / seconds : 0.0, delta, nullptr, nullptr, nullptr, nullptr, nullptr;
+                        }
+                        break;
+
+                    case kind::gauge:
+                        r += "gauge", entry->gauge->value(), nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr;
+                        break;
+
+                    case kind::histogram:
+                        {
+                            std::uint64_t sum = 0;
+                            entry->histogram->merge(_counts.data(), sum);
+
+                            // turn the cumulative counts into the interval's
+                            std::uint64_t total = 0;
+                            std::uint64_t count = 0;
+                            std::size_t top = 0;
+                            for (std::size_t b = 0; b < _counts.size(); ++b)
+                            {
+                                const std::uint64_t cumulative = _counts[b];
+                                _counts[b] = cumulative - entry->previous[b];
+                                entry->previous[b] = cumulative;
+                                total += cumulative;
+                                count += _counts[b];
+                                if (0 < _counts[b]) top = b;
+                            }
+                            const std::uint64_t delta = sum - entry->last;
+                            entry->last = sum;
+
+                            r += "histogram", total, 0 < seconds ? count / seconds : 0.0, count;
+                            if (0 < count)
+                            {
+                                r += static_cast<double>(delta) / static_cast<double>(count),
+                                    quantile(_counts, count, 0.5), quantile(_counts, count, 0.99), quantile(_counts, count, 0.999),
+                                    metrics::histogram::highest(top);
+                            }
+                            else
+                            {
+                                r += nullptr, nullptr, nullptr, nullptr, nullptr;
+                            }
+                        }
+                        break;
+                }
+            }
+        }
+
+    }
+}
@@ -0,0 +1,253 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <charconv>
+#include <cstring>
+
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
+
+namespace supermon
+{
+    namespace json
+    {
+        namespace
+        {
+            const unsigned max_depth = 128;
+        }
+
+        // builds the same tokens as the JSON parser, so handlers can't tell the encodings apart
+        template<typename Token>
+        class unpacker
+        {
+        public:
+            unpacker(const char* data, std::size_t size, std::vector<Token>& tokens) : _begin(data), _p(data), _end(data + size), _tokens(tokens)
+            {
+            }
+
+            std::size_t unpack()
+            {
+                parse_value(0);
+                if (_p != _end) fail("unexpected trailing bytes");
+                return _numbers;
+            }
+
+        private:
+            [[noreturn]] void fail(const char* what)
+            {
+                throw msgpack::error(what, _p - _begin);
+            }
+
+            template<typename T>
+            T read()
+            {
+                if (static_cast<std::size_t>(_end - _p) < sizeof(T)) fail("unexpected end of input");
+                T value = 0;
+                for (std::size_t n = 0; n < sizeof(T); ++n)
+                {
+                    value = static_cast<T>((value << 8) | static_cast<unsigned char>(*_p++));
+                }
+                return value;
+            }
+
+            std::uint32_t add(document::type kind)
+            {
+                _tokens.emplace_back();
+                Token& t = _tokens.back();
+                t.kind = kind;
+                t.integral = false;
+                t.size = 0;
+                t.i = 0;
+                t.next = static_cast<std::uint32_t>(_tokens.size());
+                return static_cast<std::uint32_t>(_tokens.size() - 1);
+            }
+
+            void integer(long long number)
+            {
+                Token& t = _tokens[add(document::type::number)];
+                t.integral = true;
+                t.i = number;
+                ++_numbers;
+            }
+
+            void real(double number)
+            {
+                _tokens[add(document::type::number)].d = number;
+                ++_numbers;
+            }
+
+            std::string_view bytes(std::size_t length)
+            {
+                if (static_cast<std::size_t>(_end - _p) < length) fail("unexpected end of input");
+                std::string_view result(_p, length);
+                _p += length;
+                return result;
+            }
+
+            void string(std::size_t length)
+            {
+                std::string_view text = bytes(length);
+                _tokens[add(document::type::string)].text = text;
+            }
+
+            // returns the length of a string or binary header, throws on anything else
+            std::size_t key()
+            {
+                if (_p == _end) fail("unexpected end of input");
+                const unsigned char c = static_cast<unsigned char>(*_p++);
+                if (0xa0 <= c && c <= 0xbf) return c & 0x1f;
+                switch (c)
+                {
+                    case 0xc4: case 0xd9: return read<std::uint8_t>();
+                    case 0xc5: case 0xda: return read<std::uint16_t>();
+                    case 0xc6: case 0xdb: return read<std::uint32_t>();
+                }
+                --_p;
+                fail("map key is not a string");
+            }
+
+            void container(document::type kind, std::uint32_t size, unsigned depth)
+            {
+                if (max_depth < depth) fail("nesting too deep");
+                // every element takes at least a byte, or two for a member, which bounds a forged size
+                const std::size_t minimum = static_cast<std::size_t>(size) * (document::type::object == kind ? 2 : 1);
+                if (static_cast<std::size_t>(_end - _p) < minimum) fail("container larger than the message");
+
+                const std::uint32_t index = add(kind);
+                for (std::uint32_t n = 0; n < size; ++n)
+                {
+                    if (document::type::object == kind)
+                    {
+                        string(key());
+                    }
+                    parse_value(depth + 1);
+                }
+                _tokens[index].size = size;
+                _tokens[index].next = static_cast<std::uint32_t>(_tokens.size());
+            }
+
+            void parse_value(unsigned depth)
+            {
+                if (_p == _end) fail("unexpected end of input");
+
+                const unsigned char c = static_cast<unsigned char>(*_p++);
+
+                if (c <= 0x7f) return integer(c);
+                if (0xe0 <= c) return integer(static_cast<signed char>(c));
+                if (0x80 <= c && c <= 0x8f) return container(document::type::object, c & 0x0f, depth);
+                if (0x90 <= c && c <= 0x9f) return container(document::type::array, c & 0x0f, depth);
+                if (0xa0 <= c && c <= 0xbf) return string(c & 0x1f);
+
+                switch (c)
+                {
+                    case 0xc0: add(document::type::null); break;
+                    case 0xc2: _tokens[add(document::type::boolean)].b = false; break;
+                    case 0xc3: _tokens[add(document::type::boolean)].b = true; break;
+
+                    // binary data is handed out like a string
+                    case 0xc4: case 0xd9: string(read<std::uint8_t>()); break;
+                    case 0xc5: case 0xda: string(read<std::uint16_t>()); break;
+                    case 0xc6: case 0xdb: string(read<std::uint32_t>()); break;
+
+                    case 0xca:
+                        {
+                            const std::uint32_t bits = read<std::uint32_t>();
+                            float number;
+                            std::memcpy(&number, &bits, sizeof(number));
+                            real(number);
+                        }
+                        break;
+                    case 0xcb:
+                        {
+                            const std::uint64_t bits = read<std::uint64_t>();
+                            double number;
+                            std::memcpy(&number, &bits, sizeof(number));
+                            real(number);
+                        }
+                        break;
+
+                    case 0xcc: integer(read<std::uint8_t>()); break;
+                    case 0xcd: integer(read<std::uint16_t>()); break;
+                    case 0xce: integer(read<std::uint32_t>()); break;
+                    case 0xcf:
+                        {
+                            // same as the JSON parser, too big for 64 bit signed falls back to a double
+                            const std::uint64_t number = read<std::uint64_t>();
+                            if (number <= static_cast<std::uint64_t>(std::numeric_limits<long long>::max())) integer(static_cast<long long>(number));
+                            else real(static_cast<double>(number));
+                        }
+                        break;
+                    case 0xd0: integer(static_cast<std::int8_t>(read<std::uint8_t>())); break;
+                    case 0xd1: integer(static_cast<std::int16_t>(read<std::uint16_t>())); break;
+                    case 0xd2: integer(static_cast<std::int32_t>(read<std::uint32_t>())); break;
+                    case 0xd3: integer(static_cast<std::int64_t>(read<std::uint64_t>())); break;
+
+                    case 0xdc: container(document::type::array, read<std::uint16_t>(), depth); break;
+                    case 0xdd: container(document::type::array, read<std::uint32_t>(), depth); break;
+                    case 0xde: container(document::type::object, read<std::uint16_t>(), depth); break;
+                    case 0xdf: container(document::type::object, read<std::uint32_t>(), depth); break;
+
+                    default:
+                        --_p;
+                        fail("unsupported type");
+                }
+            }
+
+        private:
+            const char*         _begin;
+            const char*         _p;
+            const char*         _end;
+            std::vector<Token>& _tokens;
+            std::size_t         _numbers = 0;
+        };
+
+        void document::unpack(const char* data, std::size_t size)
+        {
+            _tokens.clear();
+            std::size_t numbers = 0;
+            try
+            {
+                numbers = unpacker<token>(data, size, _tokens).unpack();
+            }
+            catch (...)
+            {
+                _tokens.clear();
+                throw;
+            }
+
+            // numbers carry no text on the wire, format them once so str() works the same as for JSON.
+            // reserving up front keeps the views valid while the buffer fills
+            const std::size_t width = 32;
+            _numbers.clear();
+            _numbers.reserve(numbers * width);
+
+            for (auto& t : _tokens)
+            {
+                if (type::number != t.kind) continue;
+
+                char digits[width];
+                auto result = t.integral ? std::to_chars(digits, digits + width, t.i) : std::to_chars(digits, digits + width, t.d);
+                const std::size_t offset = _numbers.size();
+                _numbers.append(digits, result.ptr - digits);
+                t.text = std::string_view(_numbers.data() + offset, _numbers.size() - offset);
+            }
+        }
+
+    }
+}
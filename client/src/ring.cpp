@@ -0,0 +1,191 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "supermon/ring.h"
+
+namespace supermon
+{
+
+    // a record is the frame's length and the frame, padded to 8 bytes. one that doesn't fit before
+    // the end of the buffer goes to its start, after a marker in place of the length
+    static constexpr std::uint64_t magic = 0x676e69726e6f6d73; // "smonring"
+    static constexpr std::uint64_t wrap = ~std::uint64_t(0);
+    static constexpr std::size_t header_bytes = 8;
+    static constexpr std::size_t alignment = 8;
+    static constexpr std::size_t data_offset = 4096; // the header gets a page of its own
+
+    static std::uint64_t padded(std::size_t size)
+    {
+        return (header_bytes + size + alignment - 1) & ~std::uint64_t(alignment - 1);
+    }
+
+    static std::runtime_error failure(const std::string& what, const std::string& name)
+    {
+        return std::runtime_error("ring: " + what + " '" + name + "': " + std::strerror(errno));
+    }
+
+    ring::ring(const std::string& name, std::size_t capacity, bool create) : _name('/' == name[0] ? name : "/" + name)
+    {
+        std::uint64_t bytes = 4096;
+        while (bytes < capacity) bytes *= 2;
+
+        const int fd = create ? ::shm_open(_name.c_str(), O_RDWR | O_CREAT, 0600) : ::shm_open(_name.c_str(), O_RDWR, 0);
+        if (-1 == fd) throw failure("can't open", _name);
+
+        struct stat info;
+        if (-1 == ::fstat(fd, &info))
+        {
+            ::close(fd);
+            throw failure("can't stat", _name);
+        }
+
+        _size = create ? data_offset + bytes : static_cast<std::size_t>(info.st_size);
+        if (create && 0 == info.st_size)
+        {
+            if (-1 == ::ftruncate(fd, static_cast<off_t>(_size)))
+            {
+                ::close(fd);
+                throw failure("can't size", _name);
+            }
+        }
+        else if (create && static_cast<std::size_t>(info.st_size) != _size)
+        {
+            // the relay may still have it mapped, shrinking it under the relay would kill it with SIGBUS
+            ::close(fd);
+            throw std::runtime_error("ring: '" + _name + "' is " + std::to_string(info.st_size) + " bytes, not " + std::to_string(_size) +
+                                     ", remove it while its relay is stopped to change its size");
+        }
+        else if (!create && _size <= data_offset)
+        {
+            ::close(fd);
+            errno = EAGAIN;
+            throw failure("not ready", _name);
+        }
+
+        void* data = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the object
+        if (MAP_FAILED == data) throw failure("can't map", _name);
+
+        _header = static_cast<header*>(data);
+        _data = static_cast<char*>(data) + data_offset;
+
+        if (create && (magic != _header->magic || bytes != _header->capacity))
+        {
+            _header->capacity = bytes;
+            _header->head.store(0, std::memory_order_relaxed);
+            _header->tail.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            _header->magic = magic;
+        }
+        else if (magic != _header->magic || data_offset + _header->capacity != _size)
+        {
+            ::munmap(data, _size);
+            errno = EAGAIN;
+            throw failure("not ready", _name);
+        }
+
+        _capacity = _header->capacity;
+        _head = _header->head.load(std::memory_order_acquire);
+        _tail = _header->tail.load(std::memory_order_acquire);
+    }
+
+    ring::~ring()
+    {
+        ::munmap(_header, _size);
+    }
+
+    // position of the record at or after the given one, with its frame's length
+    std::uint64_t ring::locate(std::uint64_t position, std::uint64_t& length) const
+    {
+        std::memcpy(&length, _data + (position & (_capacity - 1)), sizeof(length));
+        if (wrap == length)
+        {
+            position += _capacity - (position & (_capacity - 1));
+            std::memcpy(&length, _data, sizeof(length));
+        }
+        return position;
+    }
+
+    bool ring::push(std::string_view frame)
+    {
+        const std::uint64_t size = padded(frame.size());
+        if (size > _capacity) return false;
+
+        const std::uint64_t tail = _header->tail.load(std::memory_order_relaxed);
+        const std::uint64_t offset = tail & (_capacity - 1);
+        const std::uint64_t skip = offset + size > _capacity ? _capacity - offset : 0;
+
+        // the reader's position is looked up only when the last one seen leaves no room
+        if (tail + skip + size - _head > _capacity)
+        {
+            _head = _header->head.load(std::memory_order_acquire);
+            if (tail + skip + size - _head > _capacity) return false;
+        }
+
+        if (0 < skip)
+        {
+            std::memcpy(_data + offset, &wrap, sizeof(wrap));
+        }
+
+        char* at = _data + ((tail + skip) & (_capacity - 1));
+        const std::uint64_t length = frame.size();
+        std::memcpy(at, &length, sizeof(length));
+        std::memcpy(at + header_bytes, frame.data(), frame.size());
+
+        _header->tail.store(tail + skip + size, std::memory_order_release);
+        return true;
+    }
+
+    bool ring::front(std::string& frame)
+    {
+        const std::uint64_t head = _header->head.load(std::memory_order_relaxed);
+        if (head == _tail)
+        {
+            _tail = _header->tail.load(std::memory_order_acquire);
+            if (head == _tail) return false;
+        }
+
+        std::uint64_t length = 0;
+        const std::uint64_t position = locate(head, length);
+        frame.assign(_data + (position & (_capacity - 1)) + header_bytes, length);
+        return true;
+    }
+
+    void ring::pop()
+    {
+        const std::uint64_t head = _header->head.load(std::memory_order_relaxed);
+        if (head == _tail)
+        {
+            _tail = _header->tail.load(std::memory_order_acquire);
+            if (head == _tail) return;
+        }
+
+        std::uint64_t length = 0;
+        const std::uint64_t position = locate(head, length);
+        _header->head.store(position + padded(length), std::memory_order_release);
+    }
+
+}
@@ -0,0 +1,194 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#include "supermon/series.h"
+
+namespace supermon
+{
+
+    static std::size_t round_up(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity) size <<= 1;
+        return size;
+    }
+
+    // min, max and sum of a run of samples
+    struct summary
+    {
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        double sum = 0;
+    };
+
+    // pairs of doubles with the vector extensions of gcc and clang, native to both sse2 and neon. the compare
+    // and select is what minpd and maxpd do. two accumulators of each, so that consecutive operations don't wait
+    // for each other, more run out of registers
+    using lanes = double __attribute__((vector_size(2 * sizeof(double))));
+    constexpr std::size_t accumulators = 2;
+
+    static void summarize(const double* values, std::size_t count, summary& s)
+    {
+        constexpr std::size_t width = sizeof(lanes) / sizeof(double);
+
+        lanes lo[accumulators];
+        lanes hi[accumulators];
+        lanes sum[accumulators];
+        for (std::size_t k = 0; k < accumulators; ++k)
+        {
+            lo[k] = lanes{} + s.min;
+            hi[k] = lanes{} + s.max;
+            sum[k] = lanes{};
+        }
+
+        std::size_t i = 0;
+        for (; i + accumulators * width <= count; i += accumulators * width)
+        {
+            for (std::size_t k = 0; k < accumulators; ++k)
+            {
+                lanes v;
+                std::memcpy(&v, values + i + k * width, sizeof(v));
+                lo[k] = v < lo[k] ? v : lo[k];
+                hi[k] = hi[k] < v ? v : hi[k];
+                sum[k] += v;
+            }
+        }
+
+        double total = 0;
+        for (std::size_t k = 0; k < accumulators; ++k)
+        {
+            for (std::size_t n = 0; n < width; ++n)
+            {
+                s.min = lo[k][n] < s.min ? lo[k][n] : s.min;
+                s.max = s.max < hi[k][n] ? hi[k][n] : s.max;
+                total += sum[k][n];
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            const double v = values[i];
+            s.min = v < s.min ? v : s.min;
+            s.max = s.max < v ? v : s.max;
+            total += v;
+        }
+        s.sum += total;
+    }
+
+    series::series(const std::vector<std::string>& columns, std::size_t capacity) :
+        _columns(columns), _capacity(round_up(std::max<std::size_t>(capacity, 2))),
+        _times(_capacity), _values(_capacity * columns.size())
+    {
+        if (columns.empty()) throw std::invalid_argument("series: no columns");
+    }
+
+    void series::append(std::int64_t timestamp, const double* values, std::size_t count)
+    {
+        if (count != _columns.size())
+        {
+            throw std::invalid_argument("series: " + std::to_string(count) + " values for " + std::to_string(_columns.size()) + " columns");
+        }
+
+        std::lock_guard<std::mutex> _(_lock);
+        const std::size_t slot = static_cast<std::size_t>(_appended & (_capacity - 1));
+        _times[slot] = timestamp;
+        for (std::size_t c = 0; c < count; ++c)
+        {
+            _values[c * _capacity + slot] = values[c];
+        }
+        ++_appended;
+    }
+
+    bool series::bucket(dataset::row& row)
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        const std::uint64_t count = std::min<std::uint64_t>(_appended - _bucketed, _capacity);
+        _bucketed = _appended;
+        if (0 == count) return false;
+
+        // the samples are at most two runs, up to the end of the ring and from its start
+        const std::size_t first = static_cast<std::size_t>((_appended - count) & (_capacity - 1));
+        const std::size_t last = static_cast<std::size_t>((_appended - 1) & (_capacity - 1));
+        const std::size_t head = std::min<std::size_t>(count, _capacity - first);
+        const std::size_t tail = count - head;
+
+        row.add(static_cast<long long>(_times[first]));
+        row.add(static_cast<long long>(_times[last]));
+        row.add(static_cast<unsigned long long>(count));
+        for (std::size_t c = 0; c < _columns.size(); ++c)
+        {
+            const double* column = &_values[c * _capacity];
+
+            summary s;
+            summarize(column + first, head, s);
+            summarize(column, tail, s);
+
+            row.add(s.min);
+            row.add(s.max);
+            row.add(s.sum / count);
+            row.add(column[last]);
+        }
+        return true;
+    }
+
+    void series::points(dataset& data, std::int64_t from, std::int64_t to) const
+    {
+        point_header(data.header);
+
+        std::lock_guard<std::mutex> _(_lock);
+        const std::uint64_t count = std::min<std::uint64_t>(_appended, _capacity);
+        for (std::uint64_t n = _appended - count; n < _appended; ++n)
+        {
+            const std::size_t slot = static_cast<std::size_t>(n & (_capacity - 1));
+            if (_times[slot] < from || _times[slot] > to) continue;
+
+            dataset::row& row = data.insertRow();
+            row.add(static_cast<long long>(_times[slot]));
+            for (std::size_t c = 0; c < _columns.size(); ++c)
+            {
+                row.add(_values[c * _capacity + slot]);
+            }
+        }
+    }
+
+    void series::header(dataset::row& header) const
+    {
+        header.clear();
+        header += "From", "To", "Count";
+        for (const auto& column : _columns)
+        {
+            header += column + " min", column + " max", column + " mean", column + " last";
+        }
+    }
+
+    void series::point_header(dataset::row& header) const
+    {
+        header.clear();
+        header += "Time";
+        for (const auto& column : _columns)
+        {
+            header += column;
+        }
+    }
+
+}
@@ -0,0 +1,193 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "supermon/session.h"
+#include "supermon/agent.h"
+#include "supermon/json.h"
+#include "supermon/msgpack.h"
+
+namespace supermon
+{
+
+    // where the members after the tag start in {"@":"<tag>",...} or its msgpack counterpart, 0 if the frame has no
+    // tag up front. the server puts it there and doesn't escape anything in it, a tag is a name and an instance
+    static std::size_t untag(const char* data, std::size_t size, std::string_view& tag)
+    {
+        if (msgpack::packed(data, size))
+        {
+            const auto* p = reinterpret_cast<const unsigned char*>(data);
+            if (size < 5 || p[0] < 0x82 || p[0] > 0x8f || 0xa1 != p[1] || '@' != p[2]) return 0;
+
+            std::size_t start = 4;
+            std::size_t length = p[3] & 0x1f;
+            if (0xd9 == p[3])
+            {
+                start = 5;
+                length = p[4];
+            }
+            else if (0xa0 != (p[3] & 0xe0))
+            {
+                return 0;
+            }
+
+            if (start + length >= size) return 0;
+            tag = std::string_view(data + start, length);
+            return start + length;
+        }
+
+        static const char opening[] = "{\"@\":\"";
+        constexpr std::size_t n = sizeof(opening) - 1;
+        if (size <= n || 0 != std::memcmp(data, opening, n)) return 0;
+
+        for (std::size_t i = n; i + 1 < size; ++i)
+        {
+            if ('\\' == data[i]) return 0;
+            if ('"' != data[i]) continue;
+            if (',' != data[i + 1]) return 0;
+
+            tag = std::string_view(data + n, i - n);
+            return i + 2;
+        }
+        return 0;
+    }
+
+    session::session(boost::asio::io_service& io, const supermon::endpoint& endpoint, std::chrono::milliseconds backoff_min, std::chrono::milliseconds backoff_max)
+        : _io(io), _connection(std::make_shared<supermon::connection>(io, endpoint, backoff_min, backoff_max))
+    {
+        _connection->greet = [this](std::string& frame) { greet(frame); };
+        _connection->onopen = [this](supermon::connection&) { opened(); };
+        _connection->onclose = [this](supermon::connection&, const boost::system::error_code& error, bool lost) { closed(error, lost); };
+        _connection->onframe = [this](supermon::connection&, char* data, std::size_t size) { dispatch(data, size); };
+    }
+
+    std::size_t session::agents() const
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        return _members.size();
+    }
+
+    void session::join(agent& a)
+    {
+        _io.post([this, &a]()
+        {
+            {
+                std::lock_guard<std::mutex> _(_lock);
+                _members[a._tag] = member{ &a, state::waiting };
+            }
+
+            if (!_opened)
+            {
+                _opened = true;
+                _connection->open();
+            }
+            else if (_connection->connected())
+            {
+                // the others logged in long ago
+                opened();
+            }
+        });
+    }
+
+    void session::leave(agent& a)
+    {
+        std::lock_guard<std::mutex> _(_lock);
+        const auto it = _members.find(a._tag);
+        if (_members.end() != it && &a == it->second.agent) _members.erase(it);
+    }
+
+    std::vector<supermon::agent*> session::advance(state from, state to)
+    {
+        std::vector<supermon::agent*> agents;
+        std::lock_guard<std::mutex> _(_lock);
+        for (auto& entry : _members)
+        {
+            if (from != entry.second.stage) continue;
+            entry.second.stage = to;
+            agents.push_back(entry.second.agent);
+        }
+        return agents;
+    }
+
+    // the logins of every agent in one batch, each with its tag
+    void session::greet(std::string& frame)
+    {
+        std::string prefix;
+        json::writer w(frame);
+        w.begin_object().key("batch").begin_array();
+        for (auto* a : advance(state::waiting, state::greeted))
+        {
+            _frame.clear();
+            a->greet(_frame);
+            supermon::connection::tagged(prefix, _frame, a->_tag);
+            prefix.append(_frame, 1, std::string::npos);
+            w.raw(prefix);
+        }
+        w.end_array().end_object();
+    }
+
+    // after the login, and when agents join an open connection. those who came in between log in on their own
+    void session::opened()
+    {
+        boost::system::error_code error;
+        for (auto* a : advance(state::waiting, state::greeted))
+        {
+            _frame.clear();
+            a->greet(_frame);
+            // the read notices the connection is gone
+            if (!_connection->write(_frame, error, a->_tag)) return;
+        }
+
+        for (auto* a : advance(state::greeted, state::open))
+        {
+            a->opened(*_connection);
+        }
+    }
+
+    void session::closed(const boost::system::error_code& error, bool lost)
+    {
+        advance(state::greeted, state::waiting);
+        for (auto* a : advance(state::open, state::waiting))
+        {
+            a->closed(*_connection, error, lost);
+        }
+
+        _connection->retry();
+    }
+
+    // the tag is taken off where the frame is, so the agent reads it as if it had come alone
+    void session::dispatch(char* data, std::size_t size)
+    {
+        std::string_view tag;
+        const std::size_t offset = untag(data, size, tag);
+        if (0 == offset) return;
+
+        supermon::agent* a = nullptr;
+        {
+            std::lock_guard<std::mutex> _(_lock);
+            const auto it = _members.find(tag);
+            if (_members.end() != it) a = it->second.agent;
+        }
+        if (nullptr == a) return;
+
+        data[offset - 1] = msgpack::packed(data, size) ? static_cast<char>(data[0] - 1) : '{';
+        a->dispatch(_connection.get(), data + offset - 1, size - offset + 1);
+    }
+
+}
@@ -0,0 +1,270 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "supermon/spool.h"
+
+namespace supermon
+{
+
+    // a record is the frame's length, its complement as a check and the frame, padded to 8 bytes.
+    // a segment's unused space reads as zeros, which is where the records end
+    static constexpr std::size_t header_bytes = 8;
+    static constexpr std::size_t alignment = 8;
+
+    static std::size_t padded(std::size_t size)
+    {
+        return (header_bytes + size + alignment - 1) & ~(alignment - 1);
+    }
+
+    static std::runtime_error failure(const std::string& what, const std::string& path)
+    {
+        return std::runtime_error("spool: " + what + " '" + path + "': " + std::strerror(errno));
+    }
+
+    static void* map(const std::string& path, std::size_t size, bool create)
+    {
+        const int fd = ::open(path.c_str(), O_RDWR | (create ? O_CREAT : 0), 0644);
+        if (-1 == fd) throw failure("can't open", path);
+
+        struct stat info;
+        if (-1 == ::fstat(fd, &info))
+        {
+            ::close(fd);
+            throw failure("can't stat", path);
+        }
+
+        if (static_cast<std::size_t>(info.st_size) < size && -1 == ::ftruncate(fd, static_cast<off_t>(size)))
+        {
+            ::close(fd);
+            throw failure("can't resize", path);
+        }
+
+        void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file
+        if (MAP_FAILED == data) throw failure("can't map", path);
+        return data;
+    }
+
+    spool::spool(const std::string& directory, std::size_t segment_bytes, std::size_t segments)
+        : _directory(directory), _segment_bytes(std::max<std::size_t>(segment_bytes, 4096)), _max_segments(std::max<std::size_t>(segments, 1))
+    {
+        if (-1 == ::mkdir(_directory.c_str(), 0755) && EEXIST != errno) throw failure("can't create", _directory);
+
+        std::vector<std::uint64_t> sequences;
+        if (DIR* dir = ::opendir(_directory.c_str()))
+        {
+            while (const dirent* entry = ::readdir(dir))
+            {
+                unsigned long long sequence = 0;
+                char suffix[8] = {0};
+                if (2 == std::sscanf(entry->d_name, "%16llx.%4s", &sequence, suffix) && 0 == std::strcmp(suffix, "seg"))
+                {
+                    sequences.push_back(sequence);
+                }
+            }
+            ::closedir(dir);
+        }
+        else
+        {
+            throw failure("can't list", _directory);
+        }
+        std::sort(sequences.begin(), sequences.end());
+
+        _head = static_cast<position*>(map(_directory + "/head", sizeof(position), true));
+
+        // segments the reader was done with before the restart
+        for (std::uint64_t sequence : sequences)
+        {
+            if (sequence < _head->sequence) ::unlink(path(sequence).c_str());
+            else _segments.push_back(open(sequence, false));
+        }
+
+        if (_segments.empty())
+        {
+            _segments.push_back(open(0 < sequences.size() ? sequences.back() + 1 : _head->sequence, true));
+        }
+        if (_head->sequence != _segments.front().sequence)
+        {
+            *_head = { _segments.front().sequence, 0 };
+        }
+
+        while (1 < _segments.size() && 0 == record(_segments.front(), _head->offset))
+        {
+            drop();
+        }
+
+        // count what's left to read and find where the last writer stopped
+        std::size_t offset = _head->offset;
+        for (const auto& s : _segments)
+        {
+            while (const std::size_t length = record(s, offset))
+            {
+                offset += padded(length);
+                ++_count;
+            }
+            _tail = offset;
+            offset = 0;
+        }
+    }
+
+    spool::~spool()
+    {
+        flush();
+        for (auto& s : _segments)
+        {
+            close(s);
+        }
+        ::munmap(_head, sizeof(position));
+    }
+
+    std::string spool::path(std::uint64_t sequence) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.seg", static_cast<unsigned long long>(sequence));
+        return _directory + name;
+    }
+
+    spool::segment spool::open(std::uint64_t sequence, bool create)
+    {
+        const std::string file = path(sequence);
+
+        std::size_t size = _segment_bytes;
+        if (!create)
+        {
+            // keep the size it was written with, the setting may have changed since
+            struct stat info;
+            if (-1 == ::stat(file.c_str(), &info)) throw failure("can't stat", file);
+            size = static_cast<std::size_t>(info.st_size);
+        }
+
+        return { sequence, static_cast<char*>(map(file, size, create)), size };
+    }
+
+    void spool::close(segment& s)
+    {
+        ::munmap(s.data, s.size);
+        s.data = nullptr;
+    }
+
+    // length of the frame recorded at the offset, 0 if there is none
+    std::size_t spool::record(const segment& s, std::size_t offset) const
+    {
+        if (offset + header_bytes > s.size) return 0;
+
+        std::uint32_t header[2];
+        std::memcpy(header, s.data + offset, sizeof(header));
+        if (0 == header[0] || header[1] != ~header[0] || offset + padded(header[0]) > s.size) return 0;
+        return header[0];
+    }
+
+    // removes the first segment along with whatever is still unread in it
+    std::size_t spool::drop()
+    {
+        std::size_t lost = 0;
+        segment& s = _segments.front();
+        for (std::size_t offset = _head->offset; const std::size_t length = record(s, offset); offset += padded(length))
+        {
+            ++lost;
+        }
+        _count -= lost;
+
+        close(s);
+        ::unlink(path(s.sequence).c_str());
+        _segments.pop_front();
+        *_head = { _segments.front().sequence, 0 };
+        return lost;
+    }
+
+    std::size_t spool::append(std::string_view frame)
+    {
+        const std::size_t size = padded(frame.size());
+        if (frame.empty() || size > _segment_bytes || frame.size() > 0xffffffffu) return 1;
+
+        std::size_t lost = 0;
+
+        if (_tail + size > _segments.back().size)
+        {
+            _segments.push_back(open(_segments.back().sequence + 1, true));
+            _tail = 0;
+
+            // the reader moves on once the writer has left its segment
+            while (1 < _segments.size() && 0 == record(_segments.front(), _head->offset))
+            {
+                drop();
+            }
+            while (_segments.size() > _max_segments)
+            {
+                lost += drop();
+            }
+        }
+
+        char* data = _segments.back().data + _tail;
+        const std::uint32_t header[2] = { static_cast<std::uint32_t>(frame.size()), ~static_cast<std::uint32_t>(frame.size()) };
+        std::memcpy(data + header_bytes, frame.data(), frame.size());
+        std::memcpy(data, header, sizeof(header)); // the header last, a record is complete once it's readable
+
+        _tail += size;
+        ++_count;
+        return lost;
+    }
+
+    bool spool::front(std::string& frame) const
+    {
+        if (0 == _count) return false;
+
+        const segment& s = _segments.front();
+        const std::size_t length = record(s, _head->offset);
+        frame.assign(s.data + _head->offset + header_bytes, length);
+        return true;
+    }
+
+    void spool::pop()
+    {
+        if (0 == _count) return;
+
+        _head->offset += padded(record(_segments.front(), _head->offset));
+        --_count;
+
+        while (1 < _segments.size() && 0 == record(_segments.front(), _head->offset))
+        {
+            drop();
+        }
+    }
+
+    void spool::flush()
+    {
+        for (const auto& s : _segments)
+        {
+            ::msync(s.data, s.size, MS_ASYNC);
+        }
+        ::msync(_head, sizeof(position), MS_ASYNC);
+    }
+
+}
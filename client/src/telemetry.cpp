@@ -0,0 +1,259 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+#include <string_view>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "supermon/telemetry.h"
+
+namespace supermon
+{
+
+    // the unsigned number at p, after any blanks
+    static std::uint64_t number(const char* p)
+    {
+        while (' ' == *p || '\t' == *p) ++p;
+
+        std::uint64_t n = 0;
+        for (; '0' <= *p && *p <= '9'; ++p)
+        {
+            n = n * 10 + static_cast<std::uint64_t>(*p - '0');
+        }
+        return n;
+    }
+
+    // the number of the "<key>: <n>" line in /proc/self/io, 0 if there is none
+    static std::uint64_t lookup(const char* text, const char* key)
+    {
+        const std::size_t length = std::strlen(key);
+        for (const char* line = text; nullptr != line; )
+        {
+            if (0 == std::strncmp(line, key, length) && ':' == line[length]) return number(line + length + 1);
+
+            line = std::strchr(line, '\n');
+            if (nullptr != line) ++line;
+        }
+        return 0;
+    }
+
+    // the cpu clock of a thread of the process, made from its id the way glibc's pthread_getcpuclockid does
+    static clockid_t cpu_clock(long tid)
+    {
+        return static_cast<clockid_t>((~static_cast<unsigned int>(tid) << 3) | 6); // CPUCLOCK_SCHED | CPUCLOCK_PERTHREAD_MASK
+    }
+
+    telemetry::telemetry(std::size_t threads)
+    {
+#if defined(__linux__)
+        _statm = ::open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+        _io = ::open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+        _fds = ::opendir("/proc/self/fd");
+        _tasks = ::opendir("/proc/self/task");
+
+        const long page = ::sysconf(_SC_PAGESIZE);
+        if (0 < page) _page = static_cast<std::uint64_t>(page);
+
+        _threads.reserve(threads);
+#endif
+    }
+
+    telemetry::~telemetry()
+    {
+        if (0 <= _statm) ::close(_statm);
+        if (0 <= _io) ::close(_io);
+        if (nullptr != _fds) ::closedir(_fds);
+        if (nullptr != _tasks) ::closedir(_tasks);
+    }
+
+    void telemetry::header(dataset::row& header)
+    {
+        header.clear();
+        header += "Metric", "Value", "Rate (/s)";
+    }
+
+    // the file as it is now into the buffer, nul terminated. 0 if it couldn't be read
+    std::size_t telemetry::read(int fd)
+    {
+        const ssize_t n = ::pread(fd, _buffer.data(), _buffer.size() - 1, 0);
+        const std::size_t size = 0 < n ? static_cast<std::size_t>(n) : 0;
+        _buffer[size] = '\0';
+        return size;
+    }
+
+    // the process's times, faults and switches come from getrusage, which sums up its threads and is cheaper than
+    // /proc/self/stat and status
+    bool telemetry::collect(dataset& data, std::chrono::steady_clock::duration elapsed)
+    {
+        if (!available() || 0 == read(_statm)) return false;
+
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        const char* text = _buffer.data();
+
+        // size and resident, in pages
+        const std::uint64_t vm = number(text) * _page;
+        const char* resident = std::strchr(text, ' ');
+        const std::uint64_t rss = nullptr != resident ? number(resident) * _page : 0;
+
+        struct rusage usage;
+        if (0 != ::getrusage(RUSAGE_SELF, &usage)) return false;
+
+        std::uint64_t now[counters] = {};
+        now[user] = static_cast<std::uint64_t>(usage.ru_utime.tv_sec) * 1000000 + static_cast<std::uint64_t>(usage.ru_utime.tv_usec);
+        now[system] = static_cast<std::uint64_t>(usage.ru_stime.tv_sec) * 1000000 + static_cast<std::uint64_t>(usage.ru_stime.tv_usec);
+        now[minor_faults] = static_cast<std::uint64_t>(usage.ru_minflt);
+        now[major_faults] = static_cast<std::uint64_t>(usage.ru_majflt);
+        now[voluntary] = static_cast<std::uint64_t>(usage.ru_nvcsw);
+        now[involuntary] = static_cast<std::uint64_t>(usage.ru_nivcsw);
+        const std::uint64_t peak = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+
+        const bool io = 0 <= _io && 0 < read(_io);
+        if (io)
+        {
+            now[read_bytes] = lookup(text, "rchar");
+            now[written_bytes] = lookup(text, "wchar");
+            now[read_calls] = lookup(text, "syscr");
+            now[write_calls] = lookup(text, "syscw");
+        }
+
+        const std::size_t listed = threads();
+
+        std::uint64_t fds = 0;
+        if (nullptr != _fds)
+        {
+            ::rewinddir(_fds);
+            while (const dirent* entry = ::readdir(_fds))
+            {
+                if ('.' != entry->d_name[0]) ++fds;
+            }
+
+            // the collector's own, this directory's included
+            const std::uint64_t own = 1 + (0 <= _statm) + (0 <= _io) + (nullptr != _tasks);
+            fds = fds > own ? fds - own : 0;
+        }
+
+        // a counter with its rate, times in microseconds go out in seconds
+        const auto counted = [&](const char* name, counter c)
+        {
+            const bool time = user == c || system == c;
+            dataset::row& r = data.insertRow();
+            r += name;
+            if (time) r += static_cast<double>(now[c]) / 1e6;
+            else r += now[c];
+
+            if (_first || 0 >= seconds) r += nullptr;
+            else r += static_cast<double>(now[c] - _last[c]) / (time ? 1e6 : 1.0) / seconds;
+        };
+
+        const auto gauge = [&](const char* name, std::uint64_t value)
+        {
+            dataset::row& r = data.insertRow();
+            r += name, value, nullptr;
+        };
+
+        counted("cpu user (s)", user);
+        counted("cpu system (s)", system);
+        if (nullptr != _tasks) gauge("threads", listed);
+        gauge("rss (bytes)", rss);
+        gauge("rss peak (bytes)", peak);
+        gauge("vm (bytes)", vm);
+        if (nullptr != _fds) gauge("open files", fds);
+        counted("minor faults", minor_faults);
+        counted("major faults", major_faults);
+        counted("voluntary switches", voluntary);
+        counted("involuntary switches", involuntary);
+        if (io)
+        {
+            counted("read (bytes)", read_bytes);
+            counted("written (bytes)", written_bytes);
+            counted("read calls", read_calls);
+            counted("write calls", write_calls);
+        }
+
+        for (auto& t : _threads)
+        {
+            dataset::row& r = data.insertRow();
+            r += std::string_view(t.name.data()), static_cast<double>(t.cpu) / 1e9;
+            if (t.fresh || 0 >= seconds) r += nullptr;
+            else r += static_cast<double>(t.cpu - t.last) / 1e9 / seconds;
+
+            t.last = t.cpu;
+            t.fresh = false;
+        }
+
+        std::copy(now, now + counters, _last);
+        _first = false;
+        return true;
+    }
+
+    // the cpu time of every thread from its clock, a thread's name is read when it's first listed. the number of
+    // threads, including those not followed
+    std::size_t telemetry::threads()
+    {
+        if (nullptr == _tasks) return 0;
+
+        for (auto& t : _threads)
+        {
+            t.seen = false;
+        }
+
+        std::size_t listed = 0;
+        ::rewinddir(_tasks);
+        while (const dirent* entry = ::readdir(_tasks))
+        {
+            if ('.' == entry->d_name[0]) continue;
+            ++listed;
+
+            const long tid = std::strtol(entry->d_name, nullptr, 10);
+            auto it = std::find_if(_threads.begin(), _threads.end(), [tid](const thread& t) { return tid == t.tid; });
+            if (_threads.end() == it)
+            {
+                if (_threads.size() == _threads.capacity()) continue;
+
+                char path[32];
+                std::snprintf(path, sizeof(path), "%ld/comm", tid);
+                const int fd = ::openat(::dirfd(_tasks), path, O_RDONLY | O_CLOEXEC);
+                if (0 > fd) continue;
+                const std::size_t size = read(fd);
+                ::close(fd);
+
+                const std::string_view name(_buffer.data(), 0 < size && '\n' == _buffer[size - 1] ? size - 1 : size);
+                _threads.push_back(thread{ tid, cpu_clock(tid), 0, 0, true, false, {} });
+                it = _threads.end() - 1;
+                std::snprintf(it->name.data(), it->name.size(), "thread %ld %.*s cpu (s)", tid, static_cast<int>(name.size()), name.data());
+            }
+
+            // gone since it was listed
+            struct timespec cpu;
+            if (0 != ::clock_gettime(it->clock, &cpu)) continue;
+            it->seen = true;
+            it->cpu = static_cast<std::uint64_t>(cpu.tv_sec) * 1000000000 + static_cast<std::uint64_t>(cpu.tv_nsec);
+        }
+
+        const auto gone = std::remove_if(_threads.begin(), _threads.end(), [](const thread& t) { return !t.seen; });
+        _threads.erase(gone, _threads.end());
+
+        return listed;
+    }
+
+}
@@ -19,12 +19,26 @@
 #include <string>
 #include <thread>
 #include <tuple>
+#include <map>
+#include <random>
+#include <vector>
+#include <optional>
+#include <atomic>
+#include <cmath>
 
 #include "boost/property_tree/json_parser.hpp"
 #include "boost/program_options.hpp"
 
 #include "supermon/agent.h"
 
+// the forecast table, its columns are declared to the server by the agent instead of in schema.js
+SUPERMON_COLUMN(city, std::string, "City");
+SUPERMON_COLUMN(temperature, double, "Temperature");
+SUPERMON_COLUMN(humidity, int, "Humidity (%)");
+SUPERMON_COLUMN(wind, std::optional<double>, "Wind (km/h)");
+
+using forecast = supermon::typed_dataset<city, temperature, humidity, wind>;
+
 void badge(boost::asio::io_service& io, supermon::agent& agent)
 {
     static boost::asio::system_timer timer(io);
@@ -76,7 +90,16 @@ int main(int argc, char* argv[])
             ("alias,a",    config::value<std::string>(),                             ": use 'arg' instead of the executable's name")
             ("instance,i", config::value<std::string>(),                             ": set the process instance")
             ("host,h",     config::value<std::string>()->default_value("localhost"), ": supermon server host")
-            ("port,p",     config::value<std::uint16_t>()->default_value(8080),      ": supermon server port");
+            ("port,p",     config::value<std::uint16_t>()->default_value(8080),      ": supermon server port")
+            ("async,q",                                                              ": send from the agent's io thread via the lock-free queue")
+            ("batch,b",    config::value<long>()->default_value(0),                  ": merge pushes for 'arg' milliseconds before sending")
+            ("msgpack,m",                                                            ": offer the server MessagePack instead of JSON")
+            ("spool,s",    config::value<std::string>(),                             ": keep messages sent while offline in directory 'arg' across restarts")
+            ("backup,r",   config::value<std::vector<std::string>>(),                ": another server 'host:port' to fail over to, may be repeated")
+            ("fanout,f",                                                             ": send to the main and the backup servers at once")
+            ("ring,g",     config::value<std::string>(),                             ": go through supermon_relay over shared memory 'arg' instead of connecting")
+            ("components,c", config::value<int>()->default_value(0),                 ": also run 'arg' agents named 'component' on this thread, sharing one connection")
+            ("process,t",  config::value<long>()->default_value(1000),               ": publish the process's own cpu, memory and threads every 'arg' milliseconds, 0 disables");
 
         config::variables_map arguments;
         config::store(config::parse_command_line(argc, argv, options), arguments);
@@ -93,13 +116,37 @@ int main(int argc, char* argv[])
         boost::asio::io_service io;
         boost::asio::io_service::work work(io);
 
-        supermon::agent agent
-        ({
+        supermon::config settings
+        {
             arguments.count("alias") ? arguments["alias"].as<std::string>() : argv[0],
             arguments.count("instance") ? arguments["instance"].as<std::string>() : "A1",
             arguments["host"].as<std::string>(),
             arguments["port"].as<std::uint16_t>()
-        });
+        };
+
+        settings.async = 0 < arguments.count("async");
+        settings.batch_window = std::chrono::milliseconds(arguments["batch"].as<long>());
+        settings.encoding = 0 < arguments.count("msgpack") ? supermon::encoding::msgpack : supermon::encoding::json;
+        if (arguments.count("spool")) settings.spool_path = arguments["spool"].as<std::string>();
+        if (arguments.count("backup"))
+        {
+            settings.endpoints.push_back({ settings.host, settings.port });
+            for (const auto& backup : arguments["backup"].as<std::vector<std::string>>())
+            {
+                const auto colon = backup.rfind(':');
+                settings.endpoints.push_back({ backup.substr(0, colon), std::string::npos != colon ? static_cast<std::uint16_t>(std::stoi(backup.substr(colon + 1))) : settings.port });
+            }
+        }
+        settings.process_interval = std::chrono::milliseconds(arguments["process"].as<long>());
+        settings.series_command = "points";
+        settings.policy = 0 < arguments.count("fanout") ? supermon::policy::fanout : supermon::policy::failover;
+        if (arguments.count("ring"))
+        {
+            settings.transport = supermon::transport::ring;
+            settings.ring = arguments["ring"].as<std::string>();
+        }
+
+        supermon::agent agent(settings);
 
         // setup error and status notification handlers
         agent.onerror = [&io](const std::runtime_error& error)
@@ -127,6 +174,16 @@ int main(int argc, char* argv[])
             });
         };
 
+        agent.onreconnect = [&io](std::chrono::steady_clock::duration offline, std::size_t attempts)
+        {
+            io.post([offline, attempts]()
+            {
+                std::cout << std::this_thread::get_id() << ": reconnected after "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(offline).count() << "ms, "
+                    << attempts << " attempt(s)" << std::endl;
+            });
+        };
+
         // now set up the message handlers
 
         agent.on("modify_schema", [&](const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
@@ -153,67 +210,175 @@ int main(int argc, char* argv[])
             agent.send("warning", "raised alert '" + text + "'");
         });
 
-        agent.on("get_weather_private", [&](const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
+        // published once a second to the 'metrics' channel
+        auto& commands = agent.metrics().counter("commands");
+        auto& latency = agent.metrics().histogram("command time (us)");
+        auto& stations_count = agent.metrics().gauge("stations");
+
+        // the reports are generated on our own event pump, a couple at a time, and whatever control command
+        // comes in meanwhile goes ahead of those still waiting
+        auto pump = supermon::executor::of(io);
+        const supermon::execution reports{ pump, 2, 0 };
+        const supermon::execution control{ pump, 0, 10 };
+
+        agent.on("get_weather_private", [&](std::string_view tag, const supermon::json::value& head, const supermon::json::value& msg)
         {
-            io.post([=, &agent]()
-            {
-                agent.send("log", "executing " + head->get<std::string>("tag") + "...");
+            auto start = std::chrono::steady_clock::now();
+            auto port = head.get<long>("port");
+            agent.send("log", "executing " + std::string(tag) + "...");
 
-                auto receive_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-                auto send_time = head->get<long>("when");
+            supermon::dataset data;
+            data.header += "Port", "Text";
 
-                supermon::dataset data;
-                data.header += "Latency (ms)", "Port", "Text";
+            for (size_t n = 0; n < 10; ++n)
+            {
+                supermon::dataset::row& r = data.insertRow();
+                r += port, "This is a test";
+            }
 
-                for (size_t n = 0; n < 10; ++n)
-                {
-                    supermon::dataset::row& r = data.insertRow();
-                    r += receive_time - send_time, head->get<long>("port"), "This is a test";
-                }
+            agent.send("weather", data, port);
 
-                agent.send("weather", data, head->get<long>("port"));
-            });
-        });
+            ++commands;
+            latency.record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+        }, reports);
 
         agent.on("publish_weather_report", [&](const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
         {
-            io.post([=, &agent]()
+            auto tag = head->get<std::string>("tag");
+            agent.send("log", "executing " + tag + "...");
+
+
+            // how to deal with chrono serialization
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+
+            std::time_t t = timestamp / 1000;
+            auto ms = timestamp % 1000;
+
+            std::ostringstream os;
+            os << std::put_time(std::localtime(&t), "%T.") << std::setfill('0') << std::setw(3) << ms;
+            auto strtime = os.str();
+
+            supermon::dataset data;
+
+            for (size_t n = 0; n < 10; ++n)
             {
-                auto tag = head->get<std::string>("tag");
-                agent.send("log", "executing " + tag + "...");
+                data.insert(strtime, "foo", nullptr, false, "New York", "NY", "blah", "bar");
+                data.insert(true, strtime, "blah", tag, "London", "UK", "foo", false);
+                // or
+                supermon::dataset::row& r = data.insertRow();
+                r += strtime, 2, true, 4, nullptr, false, 7, 8.0;
+            }
 
+            agent.send("weather", data);
+        }, reports);
 
-                // how to deal with chrono serialization
-                auto now = std::chrono::system_clock::now().time_since_epoch();
-                auto timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+        // rows of the stations table are identified by the station id, republishing it sends the changes only
+        agent.key("stations", {0});
 
-                std::time_t t = timestamp / 1000;
-                auto ms = timestamp % 1000;
+        agent.on("publish_stations", [&](std::string_view tag, const supermon::json::value& head, const supermon::json::value& msg)
+        {
+            static std::map<int, std::pair<double, int>> stations; // temperature, readings
+            static int next = 0;
+            static std::mt19937 random;
 
-                std::ostringstream os;
-                os << std::put_time(std::localtime(&t), "%T.") << std::setfill('0') << std::setw(3) << ms;
-                auto strtime = os.str();
+            if (stations.empty())
+            {
+                for (; next < 10000; ++next) stations[next] = std::make_pair(15.0, 1);
+            }
 
-                supermon::dataset data;
+            // about one percent churn per publish
+            for (int n = 0; n < 80; ++n)
+            {
+                auto it = stations.lower_bound(static_cast<int>(random() % next));
+                if (stations.end() == it) continue;
+                it->second.first += static_cast<double>(random() % 21) / 10.0 - 1.0;
+                ++it->second.second;
+            }
+            for (int n = 0; n < 10; ++n)
+            {
+                auto it = stations.lower_bound(static_cast<int>(random() % next));
+                if (stations.end() != it) stations.erase(it);
+                stations[next++] = std::make_pair(15.0, 1);
+            }
 
-                for (size_t n = 0; n < 10; ++n)
-                {
-                    data.insert(strtime, "foo", nullptr, false, "New York", "NY", "blah", "bar");
-                    data.insert(true, strtime, "blah", tag, "London", "UK", "foo", false);
-                    // or
-                    supermon::dataset::row& r = data.insertRow();
-                    r += strtime, 2, true, 4, nullptr, false, 7, 8.0;
-                }
+            static supermon::dataset data;
+            data.clear();
+            for (const auto& station : stations)
+            {
+                data.insert(station.first, station.second.first, station.second.second);
+            }
 
-                agent.send("weather", data);
-            });
-        });
+            stations_count = static_cast<double>(stations.size());
+            agent.send("stations", "replace", data);
+        }, { pump, 1, 0 }); // the table is shared between runs
+
+        agent.schema<forecast>("forecast");
+
+        agent.on("publish_forecast", [&](std::string_view tag, const supermon::json::value& head, const supermon::json::value& msg)
+        {
+            static std::mt19937 random;
+            static forecast data;
+            data.clear();
+
+            for (const char* name : { "London", "New York", "Paris", "Tokyo", "Sydney" })
+            {
+                const bool calm = 0 == random() % 4;
+                data.insert(name, static_cast<double>(random() % 400) / 10.0 - 5.0, static_cast<int>(random() % 100), calm ? std::nullopt : std::optional<double>(random() % 60));
+            }
+
+            agent.send("forecast", "replace", data);
+        }, reports);
+
+        // the end of day report, too large to be put into one frame
+        agent.on("stream_forecast", [&](std::string_view tag, const supermon::json::value& head, const supermon::json::value& msg)
+        {
+            static std::mt19937 random;
+            static forecast data;
+            data.clear();
+            data.reserve(100000);
+
+            for (std::size_t n = 0; n < 100000; ++n)
+            {
+                data.insert("Station " + std::to_string(n), static_cast<double>(random() % 400) / 10.0 - 5.0, static_cast<int>(random() % 100), std::optional<double>(random() % 60));
+            }
+
+            agent.stream("forecast", "replace", data);
+        }, reports);
+
+        // answered with a table of its own, which goes to whoever asked instead of a channel
+        agent.serve("station", [&](std::string_view tag, const supermon::json::value& head, const supermon::json::value& msg)
+        {
+            static std::mt19937 random;
+            const auto name = msg.get<std::string>("name", std::string());
+            if (name.empty()) return supermon::result::failure("which station?");
+
+            supermon::result result;
+            result.data.header += "Station", "Temperature", "Readings";
+            result.data.insert(name, static_cast<double>(random() % 400) / 10.0 - 5.0, static_cast<int>(random() % 100));
+            return result;
+        }, reports);
+
+#if defined(__cpp_impl_coroutine)
+        // takes a while without holding up the pump, the other reports go on meanwhile
+        agent.serve("survey", [&](std::string tag, supermon::ptree_ptr_t head, supermon::ptree_ptr_t msg) -> supermon::task
+        {
+            supermon::result result;
+            result.data.header += "Station", "Temperature";
+            for (int n = 0; n < 5; ++n)
+            {
+                co_await supermon::delay(agent.io_service(), std::chrono::milliseconds(200));
+                result.data.insert("Station " + std::to_string(n), 15.0 + n);
+            }
+            co_return result;
+        }, reports);
+#endif
 
         agent.on("shutdown", [&](const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
         {
             agent.send("warning", "shutting down...");
             io.stop();
-        });
+        }, control);
 
         // unhandled message handler
         agent.onmessage = [&](const std::string& tag, const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
@@ -233,12 +398,62 @@ int main(int argc, char* argv[])
         // call agent.connect() *after* setting the message handlers to avoid race conditions
         agent.connect();
 
+        // a random walk sampled every 100us, published as one second buckets to the 'prices' channel.
+        // the points command sends the samples themselves
+        auto& prices = agent.series("prices", { "bid", "ask" });
+        std::atomic<bool> ticking = {true};
+        std::thread ticker([&]()
+        {
+            std::mt19937 random;
+            std::normal_distribution<double> step(0.0, 0.01);
+            double mid = 100.0;
+            while (ticking)
+            {
+                mid += step(random);
+                const double spread = 0.01 + std::abs(step(random));
+                auto now = std::chrono::system_clock::now().time_since_epoch();
+                prices.append(std::chrono::duration_cast<std::chrono::milliseconds>(now).count(), mid - spread / 2, mid + spread / 2);
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+
+        // the components are agents of their own to the server, with a connection and a thread to share
+        std::unique_ptr<supermon::session> session;
+        std::vector<std::unique_ptr<supermon::agent>> components;
+        if (0 < arguments["components"].as<int>())
+        {
+            session.reset(new supermon::session(io, { settings.host, settings.port }));
+            for (int n = 1; n <= arguments["components"].as<int>(); ++n)
+            {
+                supermon::config component;
+                component.name = "component";
+                component.instance = "C" + std::to_string(n);
+                component.encoding = settings.encoding;
+                component.metrics_interval = std::chrono::milliseconds(0);
+
+                components.emplace_back(new supermon::agent(component, *session));
+                supermon::agent& c = *components.back();
+                c.onconnect = [&c, instance = component.instance]()
+                {
+                    c.send("log", instance + " is up");
+                };
+                c.onmessage = [&c](const std::string& tag, const supermon::ptree_ptr_t& head, const supermon::ptree_ptr_t& msg)
+                {
+                    if ("ping" == tag) c.send("log", msg->get<std::string>("user"));
+                };
+                c.connect();
+            }
+        }
+
         // chage the alert|info badge periodically
         //badge(io, agent);
 
         // run our own event pump
         io.run();
 
+        ticking = false;
+        ticker.join();
+
         std::cerr << std::this_thread::get_id() << ": done." << std::endl;
     }
     catch (const std::exception& e)
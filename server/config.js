@@ -1,3 +1,34 @@
 exports.http = {
     port: 8080
 };
+
+// panics kept for the browsers to acknowledge, the oldest go first
+exports.panic = {
+    depth: 100
+};
+
+// commands are traced on their way to the agent and back. the latest samples of every command
+// are kept for the percentiles, which the server publishes to the agent's latency channel
+exports.trace = {
+    channel: 'latency',
+    samples: 1000,
+    interval: 1000
+};
+
+// what a channel keeps for browsers that subscribe later, per event type: its table and the
+// events of its history, roughly in bytes of json. the number of events is set by the schema
+exports.history = {
+    bytes: 8 * 1024 * 1024
+};
+
+// bytes a browser may have waiting to be sent before its updates are held back. what it misses
+// meanwhile is conflated to the latest table and sent once half of it has gone out
+exports.browser = {
+    budget: 4 * 1024 * 1024
+};
+
+// how long the server waits for the result of a command, in milliseconds. a command of schema.js
+// may have a timeout of its own
+exports.command = {
+    timeout: 30000
+};
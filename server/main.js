@@ -24,6 +24,7 @@ const EventEmitter = require('events');
 
 const config = require('./config');
 const schema = require('./schema');
+const msgpack = require('./msgpack');
 
 const clients = {};
 const channels = {};
@@ -40,6 +41,12 @@ function strtime(t) {
     + ('000' + t.getMilliseconds()).slice(-3);
 };
 
+// microseconds on a monotonic clock, only comparable to other stamps taken by this process
+function monotonic() {
+    const t = process.hrtime();
+    return t[0] * 1e6 + t[1] / 1e3;
+}
+
 const cmdline = getopt.create([
     ['l', 'log=ARG',     'set log verbosity. ARG=[trace|debug|info|warning|error]'],
     ['',  'dump-schema', 'dump the schema to stdout and exit'],
@@ -69,42 +76,229 @@ switch (cmdline.options.log) {
     default:        cmdline.options.log = 'error'; log.error = log.put; break;
 }
 
+// identifies a row of a keyed table by the values of its key columns
+function rowkey(key, row) {
+    return JSON.stringify(key.map((column) => { return row[column]; }));
+}
+
+// the frame last sent to browsers, { <key>: event } in json. every subscriber of an event gets it while the
+// event is being emitted, the first one serializes it and the rest send the same buffer. emitting anything
+// else starts over, events are changed in place between emits
+const shared = { key: null, event: null, frame: null };
+
+function serialize(key, event) {
+    if (shared.event !== event || shared.key !== key) {
+        shared.key = key;
+        shared.event = event;
+        shared.frame = Buffer.from(JSON.stringify({ [key]: event }));
+    }
+    return shared.frame;
+}
+
+// rough size of a value once serialized, cheaper than serializing it to find out
+function weigh(value) {
+    switch (typeof value) {
+        case 'string':
+            return value.length + 2;
+        case 'number':
+            return 8;
+        case 'object':
+            if (null == value) {
+                return 4;
+            }
+            if (Array.isArray(value)) {
+                let size = 2;
+                for (let n = 0; n < value.length; ++n) {
+                    size += weigh(value[n]) + 1;
+                }
+                return size;
+            }
+            else {
+                let size = 2;
+                for (let key in value) {
+                    size += key.length + 4 + weigh(value[key]);
+                }
+                return size;
+            }
+        default:
+            return 4;
+    }
+}
+
+// the last events of a type, oldest first. a ring allocated once, the oldest make room for the newest
+// when it's full or holds more than bytes_max of them. without bytes_max it holds any values, unweighed
+class History
+{
+    constructor(capacity, bytes_max) {
+        this.events = new Array(capacity);
+        this.sizes = new Array(capacity);
+        this.start = 0;
+        this.length = 0;
+        this.bytes = 0;
+        this.bytes_max = bytes_max;
+    }
+
+    push(event) {
+        const capacity = this.events.length;
+        if (this.length == capacity) {
+            this.drop();
+        }
+
+        const slot = (this.start + this.length) % capacity;
+        this.events[slot] = event;
+        this.sizes[slot] = this.bytes_max ? weigh(event.event) : 0;
+        this.bytes += this.sizes[slot];
+        ++this.length;
+
+        // the newest stays whatever its size
+        while (1 < this.length && this.bytes > this.bytes_max) {
+            this.drop();
+        }
+    }
+
+    drop() {
+        this.bytes -= this.sizes[this.start];
+        this.events[this.start] = undefined;
+        this.start = (this.start + 1) % this.events.length;
+        --this.length;
+    }
+
+    toArray() {
+        const events = new Array(this.length);
+        for (let n = 0; n < this.length; ++n) {
+            events[n] = this.events[(this.start + n) % this.events.length];
+        }
+        return events;
+    }
+}
+
 class EventSource extends EventEmitter
 {
     constructor(args) {
         super();
         this.setMaxListeners(0);
-        this.cache = {};
+        this.cache = {};  // event type -> History of events without a table
+        this.tables = {}; // event type -> { event, bytes }, the table as replace, append and the deltas left it
+        this.indexes = new WeakMap(); // cached snapshot -> Map of row key to row position
         const options = args || { history: 0, name: 'unnamed'};
         this.name = options.name;
         this.cache_max = options.history || 0;
+        this.rows_max = options.rows || 0;
+        this.bytes_max = options.bytes || config.history.bytes;
     }
 
+    emit() {
+        shared.event = null;
+        return super.emit.apply(this, arguments);
+    }
+
+    // a table replaces the one cached before, other events are kept in the history
     notify(type, event) {
         if (0 < this.cache_max) {
-            if (undefined == this.cache[type]) {
-                this.cache[type] = [];
+            if (event.event && event.event.hasOwnProperty('data')) {
+                const table = this.tables[type] = { event: event, bytes: weigh(event.event.data) };
+                if (table.bytes > this.bytes_max) {
+                    log.warning("table in channel '%s', event type '%s' is about %d bytes, more than the %d its history may hold", this.name, type, table.bytes, this.bytes_max);
+                }
             }
-            const history = this.cache[type];
-            while (history.length >= this.cache_max) {
-                history.shift();
+            else {
+                if (undefined == this.cache[type]) {
+                    this.cache[type] = new History(this.cache_max, this.bytes_max);
+                }
+                this.cache[type].push(event);
             }
-            history.push(event);
         }
         this.emit.apply(this, arguments);
     }
 
-    history(type) {
-        if (0 == this.cache_max) {
-            return [];
+    // applies a keyed delta to the cached snapshot and forwards the delta itself, so subscribers get the
+    // changed rows only while new ones still get the whole table. deleted rows carry just the key values and
+    // are replaced by the last row, which the browser does the same way to keep the row order in step
+    patch(type, event) {
+        const table = this.tables[type];
+        if (undefined == table || !Array.isArray(event.event.key)) {
+            log.warning("no snapshot to apply '%s' to in channel '%s', event type '%s'", event.action, this.name, type);
+            return;
         }
-        if (undefined == this.cache[type]) {
-            return [];
+
+        const snapshot = table.event;
+        const key = event.event.key;
+        const data = snapshot.event.data;
+
+        let index = this.indexes.get(snapshot);
+        if (undefined == index) {
+            index = new Map();
+            data.forEach((row, position) => { index.set(rowkey(key, row), position); });
+            this.indexes.set(snapshot, index);
         }
-        return this.cache[type];
+
+        event.event.data.forEach((row) => {
+            if ('delete' == event.action) {
+                const id = JSON.stringify(row);
+                const position = index.get(id);
+                if (undefined == position) return;
+                index.delete(id);
+                table.bytes -= weigh(data[position]);
+                const last = data.pop();
+                if (position < data.length) {
+                    data[position] = last;
+                    index.set(rowkey(key, last), position);
+                }
+            }
+            else {
+                const id = rowkey(key, row);
+                const position = index.get(id);
+                table.bytes += weigh(row);
+                if (undefined == position) {
+                    index.set(id, data.length);
+                    data.push(row);
+                }
+                else {
+                    table.bytes -= weigh(data[position]);
+                    data[position] = row;
+                }
+            }
+        });
+
+        snapshot.when = event.when;
+        this.emit(type, event);
     }
 
-    // need this to be able get the stable handler reference to unsubscribe later
+    // adds the rows to the cached table and forwards them, the table keeps the last rows_max of them and
+    // no more than bytes_max. time series buckets come this way. the first rows make the table, as if they
+    // had been a replace
+    append(type, event) {
+        const table = this.tables[type];
+        if (undefined == table) {
+            const first = Object.assign({}, event, { action: 'replace' });
+            first.event = Object.assign({}, event.event, { data: event.event.data.slice() });
+            this.notify(type, first);
+            return;
+        }
+
+        const snapshot = table.event;
+        const data = snapshot.event.data;
+        Array.prototype.push.apply(data, event.event.data);
+        table.bytes += weigh(event.event.data);
+
+        let drop = (0 < this.rows_max && data.length > this.rows_max) ? data.length - this.rows_max : 0;
+        for (let n = 0; n < drop; ++n) {
+            table.bytes -= weigh(data[n]);
+        }
+        while (drop < data.length - 1 && table.bytes > this.bytes_max) {
+            table.bytes -= weigh(data[drop++]);
+        }
+        if (0 < drop) {
+            data.splice(0, drop);
+        }
+
+        snapshot.when = event.when;
+        this.emit(type, event);
+    }
+
+    // need this to be able get the stable handler reference to unsubscribe later. a new subscriber gets the
+    // history first, all in one go if it asks for a snapshot, and the table as it is now, a single replace
+    // with every delta and appended row folded in
     subscribe(type, target, method, snapshot) {
         let handler = null;
 
@@ -116,19 +310,25 @@ class EventSource extends EventEmitter
             handler = method;
         }
 
-        const history = this.history(type);
+        shared.event = null;
 
-        if (0 < history.length) {
+        const history = this.cache[type];
+        if (undefined != history && 0 < history.length) {
             if (snapshot && 1 < history.length) {
-                handler(history);
+                handler(history.toArray());
             }
             else {
-                history.forEach((e) => {
+                history.toArray().forEach((e) => {
                     handler(e);
                 });
             }
         }
 
+        const table = this.tables[type];
+        if (undefined != table) {
+            handler(table.event);
+        }
+
         this.on(type, handler);
     }
 
@@ -138,15 +338,74 @@ class EventSource extends EventEmitter
         if (purge) {
             log.trace("purging data cache channel '" + this.name + "', event type '" + type + "'");
             if (-1 != type.indexOf('@')) {
-                if (undefined != this.cache[type]) {
-                    this.cache[type].length = 0;
-                    delete this.cache[type];
-                }
+                delete this.cache[type];
+                delete this.tables[type];
             }
         }
     }
 }
 
+// samples of the traced commands, by client and command and then by span
+const latency = {};
+
+// ids of the commands sent to the agents, a result comes back with the id of its command
+let correlation = 0;
+
+const latencyColumns = [ 'Command', 'Span', 'Count', 'p50 (ms)', 'p90 (ms)', 'p99 (ms)', 'Max (ms)' ];
+
+function percentile(sorted, q) {
+    return sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];
+}
+
+function recordLatency(client, command, spans) {
+    const clientId = client.name + '.' + client.instance;
+    const stats = latency[clientId] = latency[clientId] || { commands: {}, timer: null };
+    const entry = stats.commands[command] = stats.commands[command] || {};
+
+    // a command has its trace and its result recorded apart, each span is counted on its own
+    for (let name in spans) {
+        const span = entry[name] = entry[name] || { count: 0, samples: new History(config.trace.samples) };
+        ++span.count;
+        span.samples.push(spans[name]);
+    }
+
+    // a burst of commands refreshes the table once
+    if (null == stats.timer) {
+        stats.timer = setTimeout(() => {
+            stats.timer = null;
+            publishLatency(client, stats);
+        }, config.trace.interval);
+    }
+}
+
+function publishLatency(client, stats) {
+    const hub = channels[client.name + '.' + client.instance];
+    const channel = hub && hub[config.trace.channel];
+    if (!channel) return;
+
+    const ms = (us) => { return Math.round(us) / 1000; };
+    const data = [];
+    for (let command in stats.commands) {
+        const entry = stats.commands[command];
+        for (let name in entry) {
+            const sorted = entry[name].samples.toArray().sort((a, b) => { return a - b; });
+            data.push([ command, name, entry[name].count, ms(percentile(sorted, 0.5)), ms(percentile(sorted, 0.9)), ms(percentile(sorted, 0.99)), ms(sorted[sorted.length - 1]) ]);
+        }
+    }
+
+    channel.notify('update', {
+        channel: config.trace.channel,
+        port: 0,
+        action: 'replace',
+        event: { header: latencyColumns, data: data },
+        source: {
+            name: client.name,
+            instance: client.instance
+        },
+        when: Date.now()
+    });
+}
+
 const hints = new EventSource({ name: 'hints', history: 1 });
 const user = new EventSource({ name: 'user' });
 const api = new EventSource({ name: 'api' });
@@ -160,23 +419,48 @@ class MessageHandler
 
         this._id = ++MessageHandler._counter;
 
-        socket.on('message', (message) => { this.onmessage(socket, message); });
+        socket.on('message', (message, binary) => { this.onmessage(socket, message, binary); });
         socket.on('close', (code, reason) => { this.onclose(socket, code, reason); });
         socket.on('error', (error) => { this.onerror(error); });
 
         this.send = (message) => {
             if (!this.connected) return;
-            const buffer = JSON.stringify(message);
-            socket.send(buffer, (error) => {
+            if (undefined != this.tag) {
+                message = Object.assign({ '@': this.tag }, message);
+            }
+            const binary = ('msgpack' == this.encoding);
+            const buffer = binary ? msgpack.encode(message) : JSON.stringify(message);
+            socket.send(buffer, { binary: binary }, (error) => {
+                if (error) {
+                    log.trace("[%s.%d] failed to send '%s'", this.constructor.name, this.id, JSON.stringify(message), error);
+                }
+                else {
+                    log.trace('[%s.%d] ==> %s', this.constructor.name, this.id, binary ? JSON.stringify(message) : buffer);
+                    this.onsent();
+                }
+            });
+        }
+
+        // a json frame made by serialize() for several connections
+        this.sendFrame = (frame) => {
+            if (!this.connected) return;
+            socket.send(frame, { binary: false }, (error) => {
                 if (error) {
-                    log.trace("[%s.%d] failed to send '%s'", this.constructor.name, this.id, buffer, error);
+                    log.trace("[%s.%d] failed to send '%s'", this.constructor.name, this.id, frame, error);
                 }
                 else {
-                    log.trace('[%s.%d] ==> %s', this.constructor.name, this.id, buffer);
+                    log.trace('[%s.%d] ==> %s', this.constructor.name, this.id, frame);
+                    this.onsent();
                 }
             });
         }
 
+        // bytes sent and not handed to the network yet
+        this.buffered = () => {
+            return socket.bufferedAmount;
+        }
+
+        this.encoding = 'json';
         this.connected = true;
     }
 
@@ -184,27 +468,37 @@ class MessageHandler
         return this._id;
     }
 
-    onmessage(socket, buffer) {
+    // a frame has been handed to the network
+    onsent() {
+    }
+
+    onmessage(socket, buffer, binary) {
         try {
-            log.trace('[%s.%d] <==', this.constructor.name, this.id, buffer);
-            const message = JSON.parse(buffer);
-            const id = Object.keys(message)[0];
-            if ('function' == typeof(this['on'+id])) {
-                // timestamp the incoming message
-                if (!message[id].hasOwnProperty('when')) {
-                    message[id].when = Date.now();
-                }
-                else {
-                    message[id].when = parseInt(message[id].when);
-                }
-                this['on'+id](message[id]);
+            // older ws versions don't pass the flag, they deliver text as strings and binary frames as buffers
+            const packed = (undefined !== binary) ? binary : Buffer.isBuffer(buffer);
+            const message = packed ? msgpack.decode(buffer) : JSON.parse(buffer);
+            log.trace('[%s.%d] <==', this.constructor.name, this.id, packed ? JSON.stringify(message) : buffer);
+            this.dispatch(message);
+        }
+        catch (e) {
+            log.error("[%s.%d] failed to process incoming message: '%s'", this.constructor.name, this.id, buffer, e);
+        }
+    }
+
+    dispatch(message) {
+        const id = Object.keys(message)[0];
+        if ('function' == typeof(this['on'+id])) {
+            // timestamp the incoming message
+            if (!message[id].hasOwnProperty('when')) {
+                message[id].when = Date.now();
             }
             else {
-                log.warning("[%s.%d] unhandled message: '%s'", this.constructor.name, this.id, JSON.stringify(message));
+                message[id].when = parseInt(message[id].when);
             }
+            this['on'+id](message[id]);
         }
-        catch (e) {
-            log.error("[%s.%d] failed to process incoming message: '%s'", this.constructor.name, this.id, buffer, e);
+        else {
+            log.warning("[%s.%d] unhandled message: '%s'", this.constructor.name, this.id, JSON.stringify(message));
         }
     }
 
@@ -224,15 +518,67 @@ class MessageHandler
     }
 }
 
-class ApiMessageHandler extends MessageHandler
+// the socket of a multiplexed connection as one of its agents sees it, what it sends goes out on the
+// connection and it hears nothing, the connection's own handler reads for it
+class MultiplexedSocket extends EventEmitter
 {
     constructor(socket) {
+        super();
+        this.socket = socket;
+    }
+
+    send(data, options, callback) {
+        this.socket.send(data, options, callback);
+    }
+
+    get bufferedAmount() {
+        return this.socket.bufferedAmount;
+    }
+}
+
+class ApiMessageHandler extends MessageHandler
+{
+    // tag is "name.instance" of an agent sharing a connection, see dispatch
+    constructor(socket, tag) {
         super(socket);
+        this.socket = socket;
+        this.tag = tag;
+        this.peers = {}; // by tag
+        this.inflight = {}; // commands sent and not answered yet, by id
         api.subscribe('command', this, this.oncommand);
     }
 
+    // the agents of a process may share one connection, their frames come with their "name.instance" as "@".
+    // each gets a handler of its own on first sight, which answers through this one's socket with the tag added
+    dispatch(message) {
+        if (!message.hasOwnProperty('@')) {
+            super.dispatch(message);
+            return;
+        }
+
+        const tag = message['@'];
+        delete message['@'];
+
+        let peer = this.peers[tag];
+        if (undefined == peer) {
+            peer = this.peers[tag] = new ApiMessageHandler(new MultiplexedSocket(this.socket), String(tag));
+            log.debug("[%s.%d] agent '%s' shares the connection", this.constructor.name, this.id, tag);
+        }
+        peer.dispatch(message);
+    }
+
     onclose(socket, code, reason) {
+        for (let tag in this.peers) {
+            this.peers[tag].onclose(socket, code, reason);
+        }
+        this.peers = {};
+
+        // the connection itself logs nothing in when it's shared
         const client = clients[this.clientId];
+        if (undefined == client) {
+            super.onclose(socket, code, reason);
+            return;
+        }
 
         client.status = {
             type: 'offline',
@@ -262,7 +608,8 @@ class ApiMessageHandler extends MessageHandler
         clients[this.clientId] = login;
 
         login.commands = schema.commands[login.name] || {};
-        login.channels = schema.channels[login.name] || {};
+        login.channels = Object.assign({}, schema.channels[login.name]);
+        login.channels[config.trace.channel] = { name: 'command latency', columns: latencyColumns };
 
         if (!channels.hasOwnProperty(this.clientId)) {
             channels[this.clientId] = {};
@@ -270,23 +617,65 @@ class ApiMessageHandler extends MessageHandler
             for (let topic in login.channels) {
                 hub[topic] = new EventSource({
                     name: topic,
-                    history: login.channels[topic].hasOwnProperty('columns') ? 1 : login.channels[topic].history
+                    history: login.channels[topic].hasOwnProperty('columns') ? 1 : login.channels[topic].history,
+                    rows: login.channels[topic].rows
                 });
             }
         }
 
+        if (login.hasOwnProperty('schema')) {
+            this.declare(login, login.schema);
+            delete login.schema;
+        }
+
         login.status = {
             type: 'info',
             text: 'started',
             when: parseInt(message.timestamp)
         };
 
+        // the agent offered a binary encoding, confirm it and answer in it from now on
+        if ('msgpack' == login.encoding) {
+            this.send({ login: { head: {}, body: { encoding: 'msgpack' } } });
+            this.encoding = 'msgpack';
+        }
+
         user.notify('login', message);
     }
 
-    onschema(message)
-    {
-        log.debug('schema', JSON.stringify(message));
+    // several messages coalesced by the agent into one frame
+    onbatch(messages) {
+        messages.forEach((message) => {
+            this.dispatch(message);
+        });
+    }
+
+    // columns the agent declared after its login, browsers get the client's channels again
+    onschema(message) {
+        const client = clients[this.clientId];
+        if (undefined == client) return;
+
+        this.declare(client, message);
+        user.notify('login', client);
+    }
+
+    // {"<channel>":{"columns":[...],"types":[...]}} from the agent, which knows its tables better than schema.js.
+    // a channel only the agent knows of is made here
+    declare(login, schemas) {
+        const hub = channels[this.clientId];
+        for (let channel in schemas) {
+            const declared = schemas[channel];
+            const known = login.channels[channel];
+            if (known && Array.isArray(known.columns) && JSON.stringify(known.columns) != JSON.stringify(declared.columns)) {
+                log.warning("'%s' declares other columns for channel '%s' than schema.js: %s", this.clientId, channel, JSON.stringify(declared.columns));
+            }
+
+            login.channels[channel] = Object.assign({ name: channel }, known, { columns: declared.columns, types: declared.types });
+
+            if (!hub.hasOwnProperty(channel)) {
+                hub[channel] = new EventSource({ name: channel, history: 1, rows: login.channels[channel].rows });
+            }
+        }
     }
 
     onpush(message) {
@@ -296,16 +685,31 @@ class ApiMessageHandler extends MessageHandler
 
             let topic = 'update' + ((0 < message.port) ? ('@' + message.port) : '');
 
-            channel.notify(topic, {
+            const event = {
                 channel: message.channel,
                 port: message.port,
+                action: message.action,
                 event: message.event,
                 source: {
                     name: client.name,
                     instance: client.instance
                 },
                 when: message.when
-            });
+            };
+
+            switch (message.action) {
+                case 'insert':
+                case 'update':
+                case 'delete':
+                    channel.patch(topic, event);
+                    break;
+                case 'append':
+                    channel.append(topic, event);
+                    break;
+                default:
+                    channel.notify(topic, event);
+                    break;
+            }
 
             const hint = {
                 channel: message.channel,
@@ -328,12 +732,24 @@ class ApiMessageHandler extends MessageHandler
         const client = clients[this.clientId];
 
         if ('panic' == message.type) {
+            const count = message.repeat || 1; // a repeat summary stands for that many more of a panic sent before
+            const top = panic.messages[panic.messages.length - 1];
+
+            // a looping agent repeats itself, count it on the panic already showing
+            if (top && top.text == message.text && top.source.name == client.name && top.source.instance == client.instance) {
+                top.count += count;
+                top.when = message.when;
+                user.notify('panic', top);
+                return;
+            }
+
             ++panic.last;
 
             const event = {
                 id: panic.last,
                 text: message.text,
                 depth: panic.messages.length + 1,
+                count: count,
                 source: {
                     name: client.name,
                     instance: client.instance
@@ -342,6 +758,11 @@ class ApiMessageHandler extends MessageHandler
             };
 
             panic.messages.push(event);
+            while (panic.messages.length > config.panic.depth) {
+                panic.messages.shift();
+            }
+            event.depth = panic.messages.length;
+
             user.notify('panic', event);
 
             return;
@@ -364,21 +785,124 @@ class ApiMessageHandler extends MessageHandler
     oncommand(event) {
         if (this.clientId != event.clientId) return;
 
+        const id = String(++correlation);
         const message = {};
 
         message[event.id] = {
             head: {
+                id: id,
                 port: event.port,
-                when: event.when
+                when: event.when,
+                trace: event.trace
             },
             body: event.arguments
         };
 
+        this.track(id, event);
+        event.trace.hops.server = monotonic();
         this.send(message);
     }
 
+    // a command fails unless its result comes within the timeout of schema.js, or else of config.js
+    track(id, event) {
+        const client = clients[this.clientId];
+        const declared = client.commands[event.id];
+        const timeout = (declared && declared.timeout) || config.command.timeout;
+
+        this.inflight[id] = {
+            command: event.id,
+            port: event.port,
+            sent: monotonic(),
+            timer: setTimeout(() => {
+                recordLatency(client, event.id, { 'timed out': timeout * 1000 });
+                this.fail(id, 'timed out after ' + timeout + ' ms');
+            }, timeout)
+        };
+    }
+
+    // {"id":..., "command":..., "port":..., "error":...} or with a table as "event", from the agent once the command is done.
+    // its time since it was sent goes to the latency table. an "untracked" one only says the handler returned, the agent
+    // can't tell when it's done: there is nothing to wait for, or to time
+    onresult(message) {
+        const pending = this.inflight[message.id];
+        if (undefined == pending) {
+            log.debug("[%s.%d] result of '%s' came too late: %s", this.constructor.name, this.id, message.command, message.id);
+            return;
+        }
+        clearTimeout(pending.timer);
+        delete this.inflight[message.id];
+
+        const elapsed = monotonic() - pending.sent;
+        if (!message.untracked) recordLatency(clients[this.clientId], pending.command, { 'completion': elapsed });
+        this.complete(message.id, pending, { error: message.error, event: message.event, untracked: message.untracked, elapsed: elapsed });
+    }
+
+    fail(id, error) {
+        const pending = this.inflight[id];
+        if (undefined == pending) return;
+        clearTimeout(pending.timer);
+        delete this.inflight[id];
+
+        log.warning("[%s.%d] command '%s' of '%s' failed: %s", this.constructor.name, this.id, pending.command, this.clientId, error);
+        this.complete(id, pending, { error: error, elapsed: monotonic() - pending.sent });
+    }
+
+    // the browser that sent the command hears how it went
+    complete(id, pending, outcome) {
+        const client = clients[this.clientId];
+        user.notify('result', Object.assign({
+            id: id,
+            command: pending.command,
+            port: pending.port,
+            source: {
+                name: client.name,
+                instance: client.instance
+            },
+            when: Date.now()
+        }, outcome));
+    }
+
+    // the agent's times of a traced command, in microseconds since it read the command.
+    // spans are only taken between stamps of the same clock
+    ontrace(message) {
+        const client = clients[this.clientId];
+        const hops = message.hops || {};
+        const agent = message.agent || {};
+        const spans = {};
+
+        spans['agent dispatch'] = agent.start;
+        if (agent.hasOwnProperty('end')) {
+            spans['agent handler'] = agent.end - agent.start;
+        }
+        if (agent.hasOwnProperty('respond')) {
+            spans['agent reply'] = agent.respond;
+        }
+        if (hops.hasOwnProperty('server')) {
+            spans['round trip'] = monotonic() - hops.server;
+            spans['network'] = spans['round trip'] - (agent.respond || agent.end || agent.start);
+        }
+
+        recordLatency(client, message.command, spans);
+
+        user.notify('trace', {
+            id: message.id,
+            port: parseInt(message.port),
+            command: message.command,
+            hops: hops,
+            spans: spans,
+            source: {
+                name: client.name,
+                instance: client.instance
+            },
+            when: message.when
+        });
+    }
+
     finalize() {
         api.unsubscribe('command', this.oncommand);
+        for (let id in this.inflight) {
+            this.fail(id, 'disconnected');
+        }
         super.finalize();
     }
 }
@@ -389,6 +913,8 @@ class UserMessageHandler extends MessageHandler
         super(socket);
 
         this.topic = null;
+        this.traces = 0;
+        this.missed = null; // event type -> what to catch up on, while the browser is behind
 
         this.onupdate = this.onupdate.bind(this);
 
@@ -400,6 +926,8 @@ class UserMessageHandler extends MessageHandler
         }
 
         user.subscribe('panic', this, this.onpanic);
+        user.subscribe('trace', this, this.ontrace);
+        user.subscribe('result', this, this.onresult);
 
         const message = { 'snapshot' : clients };
         this.send(message);
@@ -416,6 +944,7 @@ class UserMessageHandler extends MessageHandler
             this.connection.unsubscribe('update@' + this.id, this.onupdate, true == purge);
             this.connection.unsubscribe('update', this.onupdate);
             this.topic = null;
+            this.missed = null;
         }
     }
 
@@ -437,6 +966,9 @@ class UserMessageHandler extends MessageHandler
 
     oncommand(message) {
         message.port = this.id;
+        // browsers that don't trace their commands get a trace id all the same
+        message.trace = message.trace || { id: this.id + '.' + (++this.traces) };
+        message.trace.hops = message.trace.hops || {};
         api.notify('command', message);
     }
 
@@ -445,37 +977,105 @@ class UserMessageHandler extends MessageHandler
             panic.messages.pop();
         }
         if (0 < panic.messages.length) {
-            user.notify('panic', panic.messages[panic.messages.length - 1]);
+            const top = panic.messages[panic.messages.length - 1];
+            top.depth = panic.messages.length; // the oldest may have been dropped since it was pushed
+            user.notify('panic', top);
         }
         else {
             user.notify('panic', {});
         }
     }
 
+    // more than its budget is waiting to be sent
+    get behind() {
+        return this.buffered() > config.browser.budget;
+    }
+
     onupdate(event) {
-        const message = { update: event };
-        this.send(message);
+        if (null != this.missed || this.behind) {
+            this.conflate(event);
+            return;
+        }
+        if (Array.isArray(event)) {
+            this.send({ update: event });
+            return;
+        }
+        this.sendFrame(serialize('update', event));
+    }
+
+    // a browser that can't keep up gets only what it would show once it has: the table as it is by then, or
+    // the last events of the channel's history
+    conflate(event) {
+        const events = Array.isArray(event) ? event : [ event ];
+        if (0 == events.length) return;
+
+        const type = 'update' + ((0 < events[0].port) ? ('@' + this.id) : '');
+        this.missed = this.missed || {};
+        const missed = this.missed[type] = this.missed[type] || { table: null, events: [] };
+
+        events.forEach((e) => {
+            if (e.event.hasOwnProperty('data')) {
+                missed.table = e;
+            }
+            else {
+                missed.events.push(e);
+            }
+        });
+
+        const max = this.connection.cache_max || 1;
+        if (missed.events.length > max) {
+            missed.events.splice(0, missed.events.length - max);
+        }
     }
 
+    onsent() {
+        if (null == this.missed || this.buffered() > config.browser.budget / 2) return;
+
+        const missed = this.missed;
+        this.missed = null;
+        for (let type in missed) {
+            const events = missed[type].events;
+            if (1 == events.length) {
+                this.sendFrame(serialize('update', events[0]));
+            }
+            else if (1 < events.length) {
+                this.send({ update: events });
+            }
+
+            if (null != missed[type].table) {
+                const table = this.connection.tables[type];
+                this.sendFrame(serialize('update', table ? table.event : missed[type].table));
+            }
+        }
+    }
+
+    ontrace(event) {
+        if (event.port != this.id) return;
+        this.sendFrame(serialize('trace', event));
+    }
+
+    onresult(event) {
+        if (event.port != this.id) return;
+        this.sendFrame(serialize('result', event));
+    }
+
+    // only a hint, a browser that is behind has more on its way
     onchannelnotempty(event) {
         if (0 < event.port && event.port != this.id) return;
-        const message = { channelnotempty: event };
-        this.send(message);
+        if (null != this.missed) return;
+        this.sendFrame(serialize('channelnotempty', event));
     }
 
     onlogin(event) {
-        const message = { login: event };
-        this.send(message);
+        this.sendFrame(serialize('login', event));
     }
 
     onstatus(event) {
-        const message = { status: event };
-        this.send(message);
+        this.sendFrame(serialize('status', event));
     }
 
     onpanic(event) {
-        const message = { panic: event };
-        this.send(message);
+        this.sendFrame(serialize('panic', event));
     }
 
     finalize() {
@@ -484,6 +1084,8 @@ class UserMessageHandler extends MessageHandler
         user.unsubscribe('login', this.onlogin);
         user.unsubscribe('status', this.onstatus);
         user.unsubscribe('panic', this.onstatus);
+        user.unsubscribe('trace', this.ontrace);
+        user.unsubscribe('result', this.onresult);
         super.finalize();
     }
 
@@ -0,0 +1,284 @@
+/* This file is part of Supermon project
+
+ Supermon is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ Supermon is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with Supermon.  If not, see http://www.gnu.org/licenses/
+ */
+
+// minimal MessagePack codec for the agent connections, covers what JSON can express
+// 64 bit integers are read into plain numbers and lose precision above 2^53
+
+const POW32 = 0x100000000;
+
+class Encoder
+{
+    constructor() {
+        this.buffer = Buffer.allocUnsafe(1024);
+        this.length = 0;
+    }
+
+    reserve(size) {
+        if (this.length + size <= this.buffer.length) return;
+        let capacity = this.buffer.length * 2;
+        while (capacity < this.length + size) capacity *= 2;
+        const buffer = Buffer.allocUnsafe(capacity);
+        this.buffer.copy(buffer, 0, 0, this.length);
+        this.buffer = buffer;
+    }
+
+    byte(value) {
+        this.reserve(1);
+        this.buffer[this.length++] = value;
+    }
+
+    header(value, fix, limit, type8, type16, type32) {
+        if (value < limit) {
+            this.byte(fix | value);
+        }
+        else if (null != type8 && value <= 0xff) {
+            this.reserve(2);
+            this.buffer[this.length++] = type8;
+            this.buffer[this.length++] = value;
+        }
+        else if (value <= 0xffff) {
+            this.reserve(3);
+            this.buffer[this.length++] = type16;
+            this.buffer.writeUInt16BE(value, this.length);
+            this.length += 2;
+        }
+        else {
+            this.reserve(5);
+            this.buffer[this.length++] = type32;
+            this.buffer.writeUInt32BE(value, this.length);
+            this.length += 4;
+        }
+    }
+
+    number(value) {
+        if (Number.isSafeInteger(value)) {
+            if (0 <= value && value < 0x80) {
+                this.byte(value);
+            }
+            else if (-32 <= value && value < 0) {
+                this.byte(value & 0xff);
+            }
+            else if (-0x80000000 <= value && value < POW32) {
+                this.reserve(5);
+                if (0 <= value) {
+                    this.buffer[this.length++] = 0xce;
+                    this.buffer.writeUInt32BE(value, this.length);
+                }
+                else {
+                    this.buffer[this.length++] = 0xd2;
+                    this.buffer.writeInt32BE(value, this.length);
+                }
+                this.length += 4;
+            }
+            else {
+                const high = Math.floor(value / POW32);
+                this.reserve(9);
+                this.buffer[this.length++] = (0 <= value) ? 0xcf : 0xd3;
+                this.buffer.writeInt32BE(high | 0, this.length);
+                this.buffer.writeUInt32BE(value - high * POW32, this.length + 4);
+                this.length += 8;
+            }
+        }
+        else {
+            this.reserve(9);
+            this.buffer[this.length++] = 0xcb;
+            this.buffer.writeDoubleBE(value, this.length);
+            this.length += 8;
+        }
+    }
+
+    string(value) {
+        const size = Buffer.byteLength(value);
+        this.header(size, 0xa0, 32, 0xd9, 0xda, 0xdb);
+        this.reserve(size);
+        this.length += this.buffer.write(value, this.length);
+    }
+
+    value(value) {
+        switch (typeof(value)) {
+            case 'string':
+                this.string(value);
+                break;
+            case 'number':
+                this.number(value);
+                break;
+            case 'boolean':
+                this.byte(value ? 0xc3 : 0xc2);
+                break;
+            case 'object':
+                if (null == value) {
+                    this.byte(0xc0);
+                }
+                else if (Array.isArray(value)) {
+                    this.header(value.length, 0x90, 16, null, 0xdc, 0xdd);
+                    value.forEach((element) => { this.value(element); });
+                }
+                else if (Buffer.isBuffer(value)) {
+                    this.header(value.length, 0, 0, 0xc4, 0xc5, 0xc6);
+                    this.reserve(value.length);
+                    value.copy(this.buffer, this.length);
+                    this.length += value.length;
+                }
+                else {
+                    // same members JSON.stringify would write
+                    const keys = Object.keys(value).filter((key) => {
+                        return undefined !== value[key] && 'function' != typeof(value[key]);
+                    });
+                    this.header(keys.length, 0x80, 16, null, 0xde, 0xdf);
+                    keys.forEach((key) => {
+                        this.string(key);
+                        this.value(value[key]);
+                    });
+                }
+                break;
+            default:
+                this.byte(0xc0);
+                break;
+        }
+    }
+}
+
+class Decoder
+{
+    constructor(buffer) {
+        this.buffer = buffer;
+        this.offset = 0;
+    }
+
+    fail(what) {
+        throw new Error('msgpack: ' + what + ' at offset ' + this.offset);
+    }
+
+    need(size) {
+        if (this.offset + size > this.buffer.length) this.fail('unexpected end of input');
+    }
+
+    uint(size) {
+        this.need(size);
+        let value = 0;
+        switch (size) {
+            case 1: value = this.buffer.readUInt8(this.offset); break;
+            case 2: value = this.buffer.readUInt16BE(this.offset); break;
+            case 4: value = this.buffer.readUInt32BE(this.offset); break;
+            case 8: value = this.buffer.readUInt32BE(this.offset) * POW32 + this.buffer.readUInt32BE(this.offset + 4); break;
+        }
+        this.offset += size;
+        return value;
+    }
+
+    int(size) {
+        this.need(size);
+        let value = 0;
+        switch (size) {
+            case 1: value = this.buffer.readInt8(this.offset); break;
+            case 2: value = this.buffer.readInt16BE(this.offset); break;
+            case 4: value = this.buffer.readInt32BE(this.offset); break;
+            case 8: value = this.buffer.readInt32BE(this.offset) * POW32 + this.buffer.readUInt32BE(this.offset + 4); break;
+        }
+        this.offset += size;
+        return value;
+    }
+
+    string(size) {
+        this.need(size);
+        const value = this.buffer.toString('utf8', this.offset, this.offset + size);
+        this.offset += size;
+        return value;
+    }
+
+    binary(size) {
+        this.need(size);
+        const value = this.buffer.slice(this.offset, this.offset + size);
+        this.offset += size;
+        return value;
+    }
+
+    array(size) {
+        const value = new Array(size);
+        for (let n = 0; n < size; ++n) {
+            value[n] = this.value();
+        }
+        return value;
+    }
+
+    map(size) {
+        const value = {};
+        for (let n = 0; n < size; ++n) {
+            const key = this.value();
+            if ('string' != typeof(key)) this.fail('map key is not a string');
+            value[key] = this.value();
+        }
+        return value;
+    }
+
+    value() {
+        this.need(1);
+        const type = this.buffer[this.offset++];
+
+        if (type < 0x80) return type;
+        if (type >= 0xe0) return type - 0x100;
+        if (type < 0x90) return this.map(type & 0x0f);
+        if (type < 0xa0) return this.array(type & 0x0f);
+        if (type < 0xc0) return this.string(type & 0x1f);
+
+        switch (type) {
+            case 0xc0: return null;
+            case 0xc2: return false;
+            case 0xc3: return true;
+            case 0xc4: return this.binary(this.uint(1));
+            case 0xc5: return this.binary(this.uint(2));
+            case 0xc6: return this.binary(this.uint(4));
+            case 0xca: this.need(4); this.offset += 4; return this.buffer.readFloatBE(this.offset - 4);
+            case 0xcb: this.need(8); this.offset += 8; return this.buffer.readDoubleBE(this.offset - 8);
+            case 0xcc: return this.uint(1);
+            case 0xcd: return this.uint(2);
+            case 0xce: return this.uint(4);
+            case 0xcf: return this.uint(8);
+            case 0xd0: return this.int(1);
+            case 0xd1: return this.int(2);
+            case 0xd2: return this.int(4);
+            case 0xd3: return this.int(8);
+            case 0xd9: return this.string(this.uint(1));
+            case 0xda: return this.string(this.uint(2));
+            case 0xdb: return this.string(this.uint(4));
+            case 0xdc: return this.array(this.uint(2));
+            case 0xdd: return this.array(this.uint(4));
+            case 0xde: return this.map(this.uint(2));
+            case 0xdf: return this.map(this.uint(4));
+        }
+
+        --this.offset;
+        this.fail('unsupported type 0x' + type.toString(16));
+    }
+}
+
+function encode(value) {
+    const encoder = new Encoder();
+    encoder.value(value);
+    return encoder.buffer.slice(0, encoder.length);
+}
+
+function decode(buffer) {
+    const decoder = new Decoder(buffer);
+    const value = decoder.value();
+    if (decoder.offset != buffer.length) decoder.fail('unexpected trailing bytes');
+    return value;
+}
+
+module.exports = {
+    encode: encode,
+    decode: decode
+};
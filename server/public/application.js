@@ -58,6 +58,7 @@ class Application
         this.reconnectTimeout = 3000; // ms
         this.reconnectAttemptsMax = Math.floor(60*1000 / this.reconnectTimeout);
         this.reconnectAttemptCount = 0;
+        this.traceCount = 0;
 
         this.connect();
     }
@@ -88,6 +89,7 @@ class Application
     onSelectedChannelChanged(e) {
         this.websocket.send(JSON.stringify({ unsubscribe: {} }));
         this.channelView.clear();
+        this.tableView = null;
 
         if (-1 != e.selectedIndex) {
             var element = this.channelsListView.element.children[e.selectedIndex];
@@ -217,11 +219,16 @@ class Application
         if (command.confirm) {
             if (!window.confirm('Are you sure you want to ' + verb + '?')) return;
         }
+        // the trace comes back with the stamp, the round trip is measured on this page's own clock
         var message = {
             command: {
                 id: commandId,
                 clientId: target.name + '.' + target.instance,
-                arguments: target.commands[commandId].arguments || {}
+                arguments: target.commands[commandId].arguments || {},
+                trace: {
+                    id: (++this.traceCount).toString(36) + '.' + Math.random().toString(36).slice(2, 8),
+                    hops: { browser: performance.now() }
+                }
             }
         };
         this.websocket.send(JSON.stringify(message));
@@ -457,10 +464,25 @@ class Application
                 it.text = (new Date(message.when)).strtime() + ': ' + message.event.text;
             }
             else if (message.event.hasOwnProperty('data')) {
+                if ('insert' == message.action || 'update' == message.action || 'delete' == message.action) {
+                    // keyed delta, applied to the table on display
+                    if (this.tableView) {
+                        this.tableView.apply(message.action, message.event);
+                    }
+                    return;
+                }
+                if ('append' == message.action && this.tableView && this.tableView.port == message.port) {
+                    // time series bucket, the table keeps as many rows as the server does
+                    this.tableView.append(message.event.data, this.clients[identify(message.source)].channels[message.channel].rows || 0);
+                    return;
+                }
                 this.channelView.maxCount = 1;
                 it = new TableView();
                 it.columns = message.event.header || this.clients[identify(message.source)].channels[message.channel].columns;
+                it.key = message.event.key;
+                it.port = message.port;
                 it.data = message.event.data;
+                this.tableView = it;
             }
             this.channelView.add(it);
         }
@@ -486,6 +508,35 @@ class Application
         }
     }
 
+    ontrace(message) {
+        var status = document.querySelector('#statusbar > .item > #trace');
+        var text = message.command;
+        if (message.hops.hasOwnProperty('browser')) {
+            text += ': ' + (performance.now() - message.hops.browser).toFixed(1) + ' ms';
+        }
+        if (message.spans.hasOwnProperty('agent reply')) {
+            text += ' (agent ' + (message.spans['agent reply'] / 1000).toFixed(1) + ' ms)';
+        }
+        status.textContent = text;
+        status.parentElement.style.display = '';
+    }
+
+    // how the command went, a table it answered with is shown in place of the channel's
+    onresult(message) {
+        var status = document.querySelector('#statusbar > .item > #result');
+        status.textContent = message.command + ': ' + (message.error || (message.untracked ? 'accepted' : 'done')) + ' (' + (message.elapsed / 1000).toFixed(1) + ' ms)';
+        status.parentElement.style.display = '';
+
+        if (message.event && message.event.hasOwnProperty('data')) {
+            this.channelView.maxCount = 1;
+            var it = new TableView();
+            it.columns = message.event.header || [];
+            it.data = message.event.data;
+            this.tableView = it;
+            this.channelView.add(it);
+        }
+    }
+
     onpanic(message) {
         var panicbar = document.querySelector('#panicbar');
         var depth = panicbar.firstElementChild;
@@ -498,7 +549,7 @@ class Application
             depth.textContent = '#' + message.depth;
             timestamp.textContent = (new Date(message.when)).strtime();
             source.textContent = message.source.name + '.' + message.source.instance;
-            text.textContent = message.text;
+            text.textContent = (1 < message.count) ? message.text + ' (x' + message.count + ')' : message.text;
             panicbar.eventId = message.id;
             show = true;
         }
@@ -159,14 +159,100 @@ class TableView extends View
         //for (var r = 1000 < src.length ? src.length - 1000 : 0; r < src.length; ++r) {
         for (var r = 0; r < src.length; ++r) {
             var row = table.insertRow();
-            var cell = row.insertCell();
-            cell.textContent = r + 1;
-            for (var c = 0; c < src[r].length; ++c) {
-                cell = row.insertCell();
-                var value = src[r][c];
-                cell.textContent = value;
-                if (null == value) {
-                    cell.classList.add('null');
+            this.fill(row, r, src[r]);
+        }
+        this.rows = src;
+        this.index = null;
+    }
+
+    // key columns of the rows, needed to apply insert, update and delete
+    set key(columns) {
+        this.columnsKey = columns;
+    }
+
+    fill(row, r, values) {
+        while (0 < row.cells.length) {
+            row.deleteCell(-1);
+        }
+        var cell = row.insertCell();
+        cell.textContent = r + 1;
+        for (var c = 0; c < values.length; ++c) {
+            cell = row.insertCell();
+            var value = values[c];
+            cell.textContent = value;
+            if (null == value) {
+                cell.classList.add('null');
+            }
+        }
+    }
+
+    // rows added at the end and the oldest dropped beyond limit, 0 keeps them all
+    append(rows, limit) {
+        if (!this.rows) return;
+
+        var body = this.element.tBodies[0];
+        for (var n = 0; n < rows.length; ++n) {
+            this.rows.push(rows[n]);
+            this.fill(body.insertRow(), this.rows.length - 1, rows[n]);
+        }
+
+        var excess = 0 < limit ? this.rows.length - limit : 0;
+        if (0 < excess) {
+            this.rows.splice(0, excess);
+            for (var n = 0; n < excess; ++n) {
+                body.deleteRow(0);
+            }
+            for (var r = 0; r < this.rows.length; ++r) {
+                body.rows[r].cells[0].textContent = r + 1;
+            }
+        }
+        this.index = null;
+    }
+
+    rowkey(row) {
+        return JSON.stringify(this.columnsKey.map(function(column) { return row[column]; }));
+    }
+
+    // same bookkeeping as EventSource.patch() on the server, a deleted row is replaced by the last one
+    apply(action, event) {
+        if (!this.columnsKey || !this.rows) return;
+
+        var body = this.element.tBodies[0];
+
+        if (null == this.index) {
+            this.index = new Map();
+            for (var r = 0; r < this.rows.length; ++r) {
+                this.index.set(this.rowkey(this.rows[r]), r);
+            }
+        }
+
+        for (var n = 0; n < event.data.length; ++n) {
+            var values = event.data[n];
+            if ('delete' == action) {
+                var id = JSON.stringify(values);
+                var position = this.index.get(id);
+                if (undefined == position) continue;
+                this.index.delete(id);
+                var last = this.rows.pop();
+                if (position < this.rows.length) {
+                    this.rows[position] = last;
+                    this.index.set(this.rowkey(last), position);
+                    this.fill(body.rows[position], position, last);
+                }
+                body.deleteRow(-1);
+            }
+            else {
+                var id = this.rowkey(values);
+                var position = this.index.get(id);
+                if (undefined == position) {
+                    position = this.rows.length;
+                    this.index.set(id, position);
+                    this.rows.push(values);
+                    this.fill(body.insertRow(), position, values);
+                }
+                else {
+                    this.rows[position] = values;
+                    this.fill(body.rows[position], position, values);
                 }
             }
         }
@@ -106,6 +106,54 @@ commands.monitor =
         description: "Update and send the weather report to this instance only",
         channel: "weather"
     },
+    publish_stations: {
+        name: "weather stations",
+        description: "Update the weather stations table, only the changed rows are sent",
+        channel: "stations"
+    },
+    points: {
+        name: "time series points",
+        description: "Send the samples of a time series at full resolution, timestamps in milliseconds",
+        parameters: {
+            channel: {
+                name: "Channel",
+                values: [
+                    { name: "prices", value: "prices" }
+                ]
+            },
+            from: {
+                name: "From"
+            },
+            to: {
+                name: "To"
+            }
+        }
+    },
+    publish_forecast: {
+        name: "forecast",
+        description: "Publish the forecast, a table whose columns the agent declares",
+        channel: "forecast"
+    },
+    stream_forecast: {
+        name: "forecast of every station",
+        description: "Stream a forecast of 100000 rows, written in fragments as it's serialized",
+        channel: "forecast"
+    },
+    station: {
+        name: "station",
+        description: "Look up a station, the answer is a table of its own",
+        parameters: {
+            name: {
+                name: "Name"
+            }
+        }
+    },
+    // a coroutine on the agent's side, only there when it's built as C++20
+    survey: {
+        name: "survey",
+        description: "Survey the stations, takes a second",
+        timeout: 5000
+    },
     raise_alert: {
         name: "raise alert",
         description: "Raise alert",
@@ -175,11 +223,41 @@ channels.monitor =
     weather: {
         name: "weather report",
         columns: [ "City", "State", "Temperature", "Comments", "City 2", "State 2", "Temperature 2", "Comments 2" ]
+    },
+    stations: {
+        name: "weather stations",
+        columns: [ "Station", "Temperature", "Readings" ]
+    },
+    // a time series, buckets are appended and the last 'rows' kept
+    prices: {
+        name: "prices",
+        columns: [ "From", "To", "Count", "bid min", "bid max", "bid mean", "bid last", "ask min", "ask max", "ask mean", "ask last" ],
+        rows: 3600
+    },
+    metrics: {
+        name: "metrics",
+        columns: [ "Metric", "Type", "Value", "Rate (/s)", "Count", "Mean", "p50", "p99", "p99.9", "Max" ]
+    },
+    // the agent's readings of /proc/self, see config::process_interval
+    process: {
+        name: "process",
+        columns: [ "Metric", "Value", "Rate (/s)" ]
     }
 };
 
 channels.monitor_test = channels.monitor;
 
+// the agents of one process sharing a connection, see the monitor's --components
+commands.component = commands.common;
+
+channels.component =
+{
+    log: {
+        name: "info (log)",
+        history: 100
+    }
+};
+
 channels.foobar = channels.monitor;
 
 